@@ -0,0 +1,323 @@
+// Micro-benchmarks for the hot functions of grid_to_radon
+//
+// Build with 'scons-3 benchmark' (not built by default, needs Google Benchmark
+// from package google-benchmark-devel), run for example
+//
+//   build/release/grid_to_radon_benchmark --benchmark_filter=RecordToJSON
+//
+// Functions are run without database access. ReadMetadata needs radon for
+// geometry and parameter lookups; the grib and radon plugins are loaded by
+// the himan plugin factory and can not be replaced with a stub, so it is
+// benchmarked only when environment
+// variable GRID_TO_RADON_BENCHMARK_GRIB names a grib file and a database
+// connection is available. Messages of the file are held in memory and
+// lookups are answered from the caches of the radon plugin after the first
+// iteration.
+
+#include "NFmiGrib.h"
+#include "common.h"
+#include "gribframer.h"
+#include "options.h"
+#include "record.h"
+#include "recordsink.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <info.h>
+#include <latitude_longitude_grid.h>
+#include <plugin_configuration.h>
+#include <unistd.h>
+
+grid_to_radon::Options options;
+
+himan::raw_time StringToTime(const std::string& dateTime, const std::string& mask);
+std::pair<std::shared_ptr<himan::configuration>, std::shared_ptr<himan::info<double>>> ReadMetadata(
+    const NFmiGribMessage& message);
+
+namespace
+{
+const himan::producer kProducer(1, "HL2MTA");
+const himan::forecast_type kForecastType(himan::kEpsPerturbation, 3);
+const himan::forecast_time kForecastTime(himan::raw_time("2026-10-19 00:00:00"),
+                                         himan::time_duration(himan::kHourResolution, 6));
+const himan::level kLevel(himan::kHeight, 2);
+const himan::param kParam("T-K", 4);
+
+std::shared_ptr<himan::configuration> MakeConfig()
+{
+	auto config = std::make_shared<himan::configuration>();
+
+	config->WriteToDatabase(true);
+	config->WriteMode(himan::kSingleGridToAFile);
+	config->DatabaseType(himan::kRadon);
+	config->TargetGeomName("MEPS2500D");
+	config->OutputFileType(himan::kGRIB2);
+	config->ProgramName(himan::kGridToRadon);
+
+	return config;
+}
+
+std::shared_ptr<himan::info<double>> MakeInfo()
+{
+	auto info = std::make_shared<himan::info<double>>(kForecastType, kForecastTime, kLevel, kParam);
+	info->Producer(kProducer);
+
+	auto b = std::make_shared<himan::base<double>>();
+	b->grid = std::make_shared<himan::latitude_longitude_grid>(himan::kBottomLeft, himan::point(-10, 50), 1000, 800,
+	                                                           0.05, 0.05, himan::earth_shape<double>(6371220.));
+
+	info->Create(b, false);
+
+	info->Find<himan::param>(kParam);
+	info->Find<himan::forecast_time>(kForecastTime);
+	info->Find<himan::level>(kLevel);
+	info->Find<himan::forecast_type>(kForecastType);
+
+	return info;
+}
+
+grid_to_radon::record MakeRecord(int step)
+{
+	const himan::forecast_time ftime(himan::raw_time("2026-10-19 00:00:00"),
+	                                 himan::time_duration(himan::kHourResolution, step));
+
+	return grid_to_radon::record("data", "meps_mepsmta_20261019", "/masala/data/meps/20261019/T-K.grib2",
+	                             himan::kGRIB2, "MEPS2500D", 1170, kProducer, kForecastType, ftime, kLevel, kParam);
+}
+
+// Empty file in the temporary directory, for functions that resolve the
+// name with std::filesystem::canonical and require the file to exist
+
+class TemporaryFile
+{
+   public:
+	TemporaryFile()
+	    : itsName(std::filesystem::temp_directory_path() /
+	              fmt::format("grid_to_radon_benchmark_{}.grib2", getpid()))
+	{
+		std::ofstream(itsName).close();
+	}
+
+	~TemporaryFile()
+	{
+		std::filesystem::remove(itsName);
+	}
+
+	TemporaryFile(const TemporaryFile&) = delete;
+	TemporaryFile& operator=(const TemporaryFile&) = delete;
+
+	const std::filesystem::path& Name() const
+	{
+		return itsName;
+	}
+
+   private:
+	std::filesystem::path itsName;
+};
+}  // namespace
+
+static void BM_StripProtocol(benchmark::State& state)
+{
+	const std::string name("s3://lake.fmi.fi/meps/20261019/00/mbr03/fc2026101900+006h00m.grib2");
+
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(grid_to_radon::common::StripProtocol(name));
+	}
+}
+BENCHMARK(BM_StripProtocol);
+
+static void BM_CanonicalFileName(benchmark::State& state)
+{
+	// Absolute name with a redundant component, independent of working directory
+
+	const TemporaryFile file;
+	const auto dir = file.Name().parent_path();
+	const std::string name = (dir / ".." / dir.filename() / file.Name().filename()).string();
+
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(grid_to_radon::common::CanonicalFileName(name));
+	}
+}
+BENCHMARK(BM_CanonicalFileName);
+
+static void BM_FormatInfoToString(benchmark::State& state)
+{
+	auto info = MakeInfo();
+
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(grid_to_radon::common::FormatInfoToString(info));
+	}
+}
+BENCHMARK(BM_FormatInfoToString);
+
+// Argument 0: name is generated from metadata, 1: in-place insert
+
+static void BM_MakeFileName(benchmark::State& state)
+{
+	auto config = MakeConfig();
+	auto info = MakeInfo();
+	const TemporaryFile file;
+	const std::string name = file.Name().string();
+
+	options.in_place_insert = (state.range(0) == 1);
+
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(grid_to_radon::common::MakeFileName(config, info, name));
+	}
+
+	options.in_place_insert = false;
+}
+BENCHMARK(BM_MakeFileName)->Arg(0)->Arg(1);
+
+static void BM_RecordToJSON(benchmark::State& state)
+{
+	const auto rec = MakeRecord(6);
+
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(grid_to_radon::RecordToJSON(rec));
+	}
+}
+BENCHMARK(BM_RecordToJSON);
+
+static void BM_WriteMetadata(benchmark::State& state)
+{
+	const std::string name = fmt::format("/tmp/grid_to_radon_benchmark_{}.json", getpid());
+	const auto rec = MakeRecord(6);
+
+	{
+		grid_to_radon::MetadataWriter writer(name);
+
+		for (auto _ : state)
+		{
+			writer.Add(rec);
+		}
+
+		writer.Close();
+	}
+
+	std::filesystem::remove(name);
+}
+BENCHMARK(BM_WriteMetadata);
+
+// Key building done for every loaded field before ss_state update
+
+static void BM_SSStateKeys(benchmark::State& state)
+{
+	grid_to_radon::records recs;
+
+	for (int step = 0; step < 67; step++)
+	{
+		recs.push_back(MakeRecord(step));
+	}
+
+	for (auto _ : state)
+	{
+		grid_to_radon::SSStateCollector collected;
+
+		for (const auto& rec : recs)
+		{
+			collected.Add(grid_to_radon::common::MakeSSStateKey(rec));
+		}
+
+		benchmark::DoNotOptimize(collected.Keys());
+	}
+
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(recs.size()));
+}
+BENCHMARK(BM_SSStateKeys);
+
+static void BM_StringToTime(benchmark::State& state)
+{
+	const std::vector<std::pair<std::string, std::string>> times{
+	    {"2026-10-19 00:00:00", "%Y-%m-%d %H:%M:%S"},
+	    {"6", "hours since 2026-10-19 00:00:00"},
+	    {"21600", "seconds since 2026-10-19T00:00:00Z"},
+	    {"0.25", "days since 2026-10-19 00:00:00"}};
+
+	const auto& t = times[static_cast<size_t>(state.range(0))];
+
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(StringToTime(t.first, t.second));
+	}
+
+	state.SetLabel(t.second);
+}
+BENCHMARK(BM_StringToTime)->DenseRange(0, 3);
+
+static void BM_ReadMetadata(benchmark::State& state, std::vector<std::unique_ptr<NFmiGrib>>* readers)
+{
+	size_t i = 0;
+
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(ReadMetadata((*readers)[i]->Message()));
+		i = (i + 1) % readers->size();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	benchmark::Initialize(&argc, argv);
+
+	// Canned messages: buffers and readers must live until benchmarks are run
+
+	std::vector<std::vector<char>> buffers;
+	std::vector<std::unique_ptr<NFmiGrib>> readers;
+
+	const char* gribFile = getenv("GRID_TO_RADON_BENCHMARK_GRIB");
+
+	if (gribFile)
+	{
+		const int fd = open(gribFile, O_RDONLY);
+
+		if (fd != -1)
+		{
+			for (const auto& pos : grid_to_radon::gribframer::Scan(fd, std::filesystem::file_size(gribFile)))
+			{
+				if (pos.length == 0)
+				{
+					continue;
+				}
+
+				buffers.emplace_back(pos.length);
+
+				if (pread(fd, buffers.back().data(), pos.length, static_cast<off_t>(pos.offset)) !=
+				    static_cast<ssize_t>(pos.length))
+				{
+					buffers.pop_back();
+				}
+			}
+
+			close(fd);
+		}
+
+		for (auto& buffer : buffers)
+		{
+			auto reader = std::make_unique<NFmiGrib>();
+
+			if (reader->Open(std::unique_ptr<FILE>(fmemopen(buffer.data(), buffer.size(), "r"))) &&
+			    reader->NextMessage())
+			{
+				readers.push_back(std::move(reader));
+			}
+		}
+
+		if (!readers.empty())
+		{
+			benchmark::RegisterBenchmark("BM_ReadMetadata", BM_ReadMetadata, &readers);
+		}
+	}
+
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace grid_to_radon
+{
+// Blocking FIFO queue with a maximum size. Producer blocks when the queue is
+// full; consumers block when it is empty until Close() is called.
+
+template <typename T>
+class BoundedQueue
+{
+   public:
+	explicit BoundedQueue(size_t capacity) : itsCapacity(capacity), itsClosed(false)
+	{
+	}
+
+	void Push(T&& item)
+	{
+		std::unique_lock<std::mutex> lock(itsMutex);
+		itsNotFull.wait(lock, [this]() { return itsQueue.size() < itsCapacity; });
+		itsQueue.push_back(std::move(item));
+		itsNotEmpty.notify_one();
+	}
+
+	// Returns false when the queue is closed and empty
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(itsMutex);
+		itsNotEmpty.wait(lock, [this]() { return !itsQueue.empty() || itsClosed; });
+
+		if (itsQueue.empty())
+		{
+			return false;
+		}
+
+		item = std::move(itsQueue.front());
+		itsQueue.pop_front();
+		itsNotFull.notify_one();
+		return true;
+	}
+
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+		itsClosed = true;
+		itsNotEmpty.notify_all();
+	}
+
+   private:
+	size_t itsCapacity;
+	bool itsClosed;
+	std::deque<T> itsQueue;
+	std::mutex itsMutex;
+	std::condition_variable itsNotFull;
+	std::condition_variable itsNotEmpty;
+};
+}  // namespace grid_to_radon
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "record.h"
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace grid_to_radon
+{
+// Journal of completed work items (grib messages, netcdf slices) of one input
+// file. Items are appended to the checkpoint file and synced to disk every
+// --checkpoint-interval items, so that a load that is interrupted can be
+// continued with --resume. The ss_state information of completed items is
+// stored too, so that ss_state is complete after the resumed load finishes.
+
+class Checkpoint
+{
+   public:
+	explicit Checkpoint(const std::string& theInputFileName);
+	~Checkpoint();
+
+	Checkpoint(const Checkpoint&) = delete;
+	Checkpoint& operator=(const Checkpoint&) = delete;
+
+	bool Enabled() const;
+
+	// Returns true if item was completed by an earlier run
+	bool IsDone(const std::string& item) const;
+
+	void Done(const std::string& item);
+	void Done(const std::string& item, const record& rec);
+
+	// Write pending items to disk
+	void Flush();
+
+	// Remove checkpoint file after a successful load
+	void Remove();
+
+	size_t ResumedCount() const;
+	ss_state_keys ResumedKeys() const;
+
+   private:
+	void Read(const std::string& header);
+	void Append(const std::string& line);
+
+	std::string itsFileName;
+	int itsFd;
+	std::map<std::string, std::optional<ss_state_key>> itsResumed;
+	std::string itsPending;
+	size_t itsPendingCount;
+	std::mutex itsMutex;
+};
+}  // namespace grid_to_radon
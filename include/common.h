@@ -1,7 +1,10 @@
 #include "record.h"
+#include <cstdint>
 #include <file_information.h>
 #include <info.h>
+#include <optional>
 #include <plugin_configuration.h>
+#include <vector>
 
 namespace himan
 {
@@ -20,6 +23,8 @@ std::pair<bool, grid_to_radon::record> SaveToDatabase(std::shared_ptr<himan::con
                                                       std::shared_ptr<himan::plugin::radon>& r,
                                                       const himan::file_information& finfo);
 void UpdateSSState(const grid_to_radon::records& records);
+void UpdateSSState(const grid_to_radon::ss_state_keys& keys);
+grid_to_radon::ss_state_key MakeSSStateKey(const grid_to_radon::record& rec);
 
 std::string CanonicalFileName(const std::string& inputFileName);
 std::string MakeFileName(std::shared_ptr<himan::configuration>& config, std::shared_ptr<himan::info<double>>& info,
@@ -28,5 +33,25 @@ void CreateDirectory(const std::string& theFileName);
 bool CheckForFailure(int g_failed, int g_skipped, int g_success);
 std::string StripProtocol(const std::string& str);
 std::string FormatInfoToString(std::shared_ptr<himan::info<double>>& info);
+
+// Content hash based detection of fields that are already registered with identical data
+uint64_t HashMessage(const std::vector<unsigned char>& data);
+std::string HashKey(std::shared_ptr<himan::configuration>& config, std::shared_ptr<himan::info<double>>& info);
+std::optional<grid_to_radon::record> FindUnchanged(std::shared_ptr<himan::configuration>& config,
+                                                   std::shared_ptr<himan::info<double>>& info,
+                                                   std::shared_ptr<himan::plugin::radon>& r, const std::string& key,
+                                                   uint64_t hash, const std::string& fileLocation);
+void SaveHash(std::shared_ptr<himan::plugin::radon>& r, const std::string& key, uint64_t hash,
+              const grid_to_radon::record& rec);
+
+// Graceful shutdown on SIGTERM and SIGINT: loaders stop taking new work.
+// Installed only with --checkpoint-dir or --follow; a second signal
+// terminates the process.
+void InstallSignalHandlers();
+bool StopRequested();
+
+// Loading of one part of a grib file (--shard, --byte-range)
+bool Sharded();
+std::pair<size_t, size_t> ShardRange(size_t fileSize);
 }  // namespace common
 }  // namespace grid_to_radon
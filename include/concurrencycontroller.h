@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace grid_to_radon
+{
+// Adjusts the number of active worker threads during a run (-j auto).
+//
+// All workers are started, but only the first Active() of them take new
+// work; the rest wait in WaitActive(). Every few seconds throughput
+// (messages/s) of the last interval is compared to the previous one and the
+// worker count is moved one step in the direction that improved it (hill
+// climbing). Workers are not added when the process already uses the cpu
+// quota of its cgroup.
+
+class ConcurrencyController
+{
+   public:
+	explicit ConcurrencyController(bool enabled);
+	~ConcurrencyController();
+
+	ConcurrencyController(const ConcurrencyController&) = delete;
+	ConcurrencyController& operator=(const ConcurrencyController&) = delete;
+
+	bool Enabled() const;
+
+	// Number of worker threads to start
+	short MaxWorkers() const;
+	short Active() const;
+
+	void Start();
+	void Stop();
+
+	// Blocks while worker is not active. Returns immediately after Finish().
+	void WaitActive(short threadId);
+
+	// Input is exhausted: release all waiting workers
+	void Finish();
+
+	// Worker completed one message, with stage times in ms
+	void Completed();
+	void StageTimes(size_t metadataTime, size_t writeTime, size_t databaseTime);
+
+	// Number of cpus available to this process, from cgroup cpu quota if set
+	static double CPULimit();
+
+   private:
+	void Run();
+
+	bool itsEnabled;
+	short itsMaxWorkers;
+	std::atomic<short> itsActive;
+	bool itsFinished;
+	bool itsStopped;
+
+	std::atomic<size_t> itsCompleted;
+	std::atomic<size_t> itsTimedCount;
+	std::atomic<size_t> itsMetadataTime;
+	std::atomic<size_t> itsWriteTime;
+	std::atomic<size_t> itsDatabaseTime;
+
+	std::mutex itsMutex;
+	std::condition_variable itsWorkerCondition;
+	std::condition_variable itsControllerCondition;
+	std::thread itsThread;
+};
+}  // namespace grid_to_radon
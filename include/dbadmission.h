@@ -0,0 +1,31 @@
+#pragma once
+
+namespace grid_to_radon
+{
+namespace dbadmission
+{
+// Limits the number of concurrent radon operations of all grid_to_radon
+// processes on a host (--max-db-concurrency). Each operation holds an
+// exclusive flock() on one of N slot files in a shared directory; the kernel
+// releases the lock if the process dies. When database latency rises above
+// the lowest latency seen, the number of slots used is reduced accordingly,
+// so that all processes back off together.
+
+class Slot
+{
+   public:
+	Slot();
+	~Slot();
+
+	Slot(const Slot&) = delete;
+	Slot& operator=(const Slot&) = delete;
+
+   private:
+	int itsFd;
+	double itsStart;
+};
+
+// Log time spent waiting for a slot
+void Report();
+}  // namespace dbadmission
+}  // namespace grid_to_radon
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace grid_to_radon
+{
+// Statistics of the values of one field (--field-stats). Missing values are
+// NaN, as in himan. count is zero if statistics were not computed.
+
+struct field_stats
+{
+	size_t count = 0;
+	size_t missing = 0;
+	double min = 0;
+	double max = 0;
+	double mean = 0;
+};
+
+namespace fieldstats
+{
+// Uses AVX-512 or AVX2 kernel when the cpu supports it
+field_stats Compute(const double* values, size_t size);
+field_stats Compute(const std::vector<double>& values);
+}  // namespace fieldstats
+}  // namespace grid_to_radon
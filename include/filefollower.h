@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace grid_to_radon
+{
+// Reads a file that is still being written (--follow). When the end of the
+// file is reached, reading waits for the file to grow (inotify IN_MODIFY,
+// with periodic polling as a fallback) instead of returning. Following ends
+// when
+//
+//   * the sentinel file exists and all data of the file has been read
+//     (--follow-sentinel)
+//   * the file has not grown for the idle timeout (--follow-idle-timeout)
+//   * stop is requested with a signal
+
+class FileFollower
+{
+   public:
+	FileFollower(int fd, const std::string& theFileName);
+	~FileFollower();
+
+	FileFollower(const FileFollower&) = delete;
+	FileFollower& operator=(const FileFollower&) = delete;
+
+	// Read length bytes, waiting for more data if needed. Returns less than
+	// length only when following has ended.
+	size_t Read(unsigned char* buffer, size_t length);
+
+   private:
+	// Returns false if following should end
+	bool Wait();
+	bool HasMoreData() const;
+
+	int itsFd;
+	std::string itsFileName;
+	int itsInotifyFd;
+	std::chrono::steady_clock::time_point itsLastData;
+	bool itsEnded;
+};
+}  // namespace grid_to_radon
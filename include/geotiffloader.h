@@ -1,14 +1,54 @@
-#include "record.h"
+#pragma once
+
+#include "recordsink.h"
+#include <fstream>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace grid_to_radon
 {
+// Tile layout of one band of a Cloud-Optimized GeoTIFF. Offsets and byte counts
+// are listed row by row; sparse tiles have zero offset and byte count.
+
+struct tile_layout
+{
+	int band;
+	int tile_width;
+	int tile_height;
+	int tiles_x;
+	int tiles_y;
+	std::vector<unsigned long> offsets;
+	std::vector<unsigned long> byte_counts;
+};
+
+// Writes tile index of all geotiff files of the run (--tile-index) as json
+// lines, one line per band. File is truncated when the writer is created.
+// Add() may be called from several threads.
+
+class TileIndexWriter
+{
+   public:
+	explicit TileIndexWriter(const std::string& theFileName);
+
+	TileIndexWriter(const TileIndexWriter&) = delete;
+	TileIndexWriter& operator=(const TileIndexWriter&) = delete;
+
+	void Add(const std::string& fileName, const std::vector<tile_layout>& layouts);
+
+   private:
+	std::string itsFileName;
+	std::ofstream itsStream;
+	std::mutex itsMutex;
+};
+
 class GeoTIFFLoader
 {
    public:
 	GeoTIFFLoader() = default;
 	~GeoTIFFLoader() = default;
 
-	std::pair<bool, records> Load(const std::string& theInfile) const;
+	// Tile layouts of bands are added to tileIndex if given
+	bool Load(const std::string& theInfile, RecordSink& sink, TileIndexWriter* tileIndex = nullptr) const;
 };
 }
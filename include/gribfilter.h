@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class NFmiGribMessage;
+
+namespace grid_to_radon
+{
+// Filter over integer grib keys, checked directly from the message handle
+// before any metadata is resolved (--filter). Expression is a comma separated
+// list of clauses that all must match:
+//
+//   key=values     key value is one of values
+//   key!=values    key value is none of values
+//
+// Values are separated with '/' and each value is either a number or an
+// inclusive range 'first..last', for example:
+//
+//   discipline=0,parameterCategory=1/6,typeOfFirstFixedSurface=103,endStep=0..24
+
+class GribFilter
+{
+   public:
+	GribFilter() = default;
+
+	// Throws std::invalid_argument if expression is not valid
+	explicit GribFilter(const std::string& expression);
+
+	bool Empty() const;
+
+	// Returns true if message should be loaded
+	bool Matches(NFmiGribMessage& message) const;
+
+   private:
+	struct clause
+	{
+		std::string key;
+		bool negate;
+		std::vector<std::pair<long, long>> ranges;
+	};
+
+	std::vector<clause> itsClauses;
+};
+}  // namespace grid_to_radon
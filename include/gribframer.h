@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace grid_to_radon
+{
+namespace gribframer
+{
+// Number of bytes needed from the start of a message to determine its length
+const size_t kHeaderSize = 16;
+
+// Returns true if buffer starts with GRIB marker
+bool IsMessageStart(const unsigned char* data, size_t size);
+
+// Returns total length of message from section 0, or 0 if header is not a
+// valid GRIB edition 1 or 2 header. Large GRIB1 messages (> 8MB, length
+// coded with the ECMWF extension) are not supported and return 0.
+size_t MessageLength(const unsigned char* header, size_t size);
+
+// Returns true if a complete message ends with the 7777 terminator
+bool IsMessageComplete(const unsigned char* message, size_t length);
+
+// Returns length of the sections that precede the bitmap and data sections
+// (GRIB1 sections 0-2, GRIB2 sections 0-5 of the first field), or 0 if they
+// do not end within size bytes. Header keys can be decoded from this part of
+// the message alone.
+size_t HeaderSectionsLength(const unsigned char* message, size_t size);
+
+// Length is zero for a message that starts with a GRIB marker but can not be
+// framed (unsupported or invalid length, missing 7777). It still takes a
+// message number, so that numbering is the same as when reading the file
+// sequentially, and should be reported as failed.
+
+struct message_position
+{
+	unsigned int message_no;
+	size_t offset;
+	size_t length;
+};
+
+// Find all messages of a file by following section 0 lengths from one message
+// to the next, reading only the headers. Data between messages is skipped by
+// searching for the next GRIB marker.
+std::vector<message_position> Scan(int fd, size_t fileSize);
+}  // namespace gribframer
+}  // namespace grid_to_radon
@@ -1,26 +1,81 @@
 #pragma once
 
 #include "NFmiGrib.h"
+#include "boundedqueue.h"
+#include "checkpoint.h"
+#include "concurrencycontroller.h"
+#include "gribfilter.h"
+#include "gribframer.h"
+#include "hybridlevelheight.h"
 #include "options.h"
-#include "record.h"
+#include "recordsink.h"
+#include "ssstatepublisher.h"
 #include <atomic>
+#include <file_information.h>
+#include <functional>
+#include <info.h>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <plugin_configuration.h>
 #include <string>
+#include <vector>
 
 namespace grid_to_radon
 {
+// One grib message read from a stream, framed but not decoded
+struct stream_message
+{
+	unsigned int message_no;
+	unsigned long offset;
+	std::vector<unsigned char> data;
+};
+
+// Output file shared by all messages of one producer, analysis time and
+// geometry when --consolidated-output-dir is used
+struct consolidated_file
+{
+	std::mutex mutex;
+	unsigned long offset = 0;
+	unsigned int message_no = 0;
+};
+
 class GribLoader
 {
    public:
 	GribLoader();
 	virtual ~GribLoader() = default;
 
-	std::pair<bool, records> Load(const std::string& theInfile);
+	// Statistics for table hybrid_level_height are added to hybridLevelHeight if given
+	bool Load(const std::string& theInfile, RecordSink& sink, HybridLevelHeight* hybridLevelHeight = nullptr);
 
    protected:
 	void Run(short threadId);
 	bool DistributeMessages(NFmiGribMessage& newMessage, unsigned int& messageNo);
-	void Process(NFmiGribMessage& message, short threadId, unsigned int messageNo);
+	void Process(NFmiGribMessage& message, short threadId, unsigned int messageNo, unsigned long offset,
+	             const std::vector<unsigned char>& data = {});
+	void Complete(std::shared_ptr<himan::configuration>& config, std::shared_ptr<himan::info<double>>& info,
+	              record& rec, unsigned int messageNo, unsigned long offset);
+	std::string CheckpointItem(unsigned int messageNo, unsigned long offset);
+	void Repack(NFmiGribMessage& message, short threadId, unsigned int messageNo);
+
+	std::string ConsolidatedFileName(std::shared_ptr<himan::configuration>& config,
+	                                 std::shared_ptr<himan::info<double>>& info, long edition);
+	void WriteConsolidated(NFmiGribMessage& message, const std::string& theFileName, himan::file_information& finfo);
+
+	short WorkerCount() const;
+
+	void LoadStream(const std::function<void(BoundedQueue<stream_message>&)>& reader);
+	void ReadStream(const std::function<size_t(unsigned char*, size_t)>& readBytes,
+	                BoundedQueue<stream_message>& queue);
+	void LoadFollow(const std::string& theInfile);
+
+	void LoadThreaded(const std::string& theInfile);
+	void LoadIndexed(const std::string& theInfile);
+	void Prioritize(int fd, std::vector<gribframer::message_position>& positions);
+	void ReadPositions(int fd, const std::vector<gribframer::message_position>& positions,
+	                   BoundedQueue<stream_message>& queue);
+	void RunStream(short threadId, BoundedQueue<stream_message>& queue);
 
 	NFmiGrib itsReader;
 
@@ -30,11 +85,33 @@ class GribLoader
 	std::atomic<int> g_success;
 	std::atomic<int> g_skipped;
 	std::atomic<int> g_failed;
+	std::atomic<int> g_unchanged;
+	std::atomic<int> g_resumed;
+	std::atomic<int> g_repacked;
+
+	// Size of repacked messages before and after repacking, bytes
+	std::atomic<size_t> g_repackInputBytes;
+	std::atomic<size_t> g_repackOutputBytes;
+
+	// Cpu time used in repacking, microseconds
+	std::atomic<size_t> g_repackTime;
 
 	std::mutex distMutex;
 
-	records itsRecords;
+	RecordSink* itsSink;
+	SSStateCollector itsCollected;
 	std::string itsHostName;
 	std::string itsInputFileName;
+	bool itsSkipUnchanged;
+	std::unique_ptr<Checkpoint> itsCheckpoint;
+
+	ConcurrencyController itsController;
+	std::unique_ptr<SSStatePublisher> itsPublisher;
+	HybridLevelHeight* itsHybridLevelHeight;
+	GribFilter itsFilter;
+
+	std::string itsRunId;
+	std::map<std::string, std::unique_ptr<consolidated_file>> itsConsolidatedFiles;
+	std::mutex itsConsolidatedMutex;
 };
 }
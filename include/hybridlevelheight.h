@@ -0,0 +1,53 @@
+#pragma once
+
+#include "fieldstats.h"
+#include <info.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace grid_to_radon
+{
+// Fills table hybrid_level_height from the fields of the run
+// (--hybrid-level-height), as python/calc_hybrid_level_height.py does with a
+// separate read of the data. Statistics of pressure (P-HPA) and height (HL-M)
+// fields of the hybrid levels of the first 24 hours are collected while
+// loading from all input files, and per level minimum, maximum and average
+// (with standard deviation over forecast steps) are written once at the end
+// of the run.
+
+class HybridLevelHeight
+{
+   public:
+	// Returns true if statistics of the field are needed
+	static bool Wanted(const himan::info<double>& info);
+
+	// Add statistics of one field, may be called from several threads
+	void Add(const himan::info<double>& info, const std::string& geometryName, const field_stats& stats);
+
+	// Statistics of the run are incomplete, for example because fields of a
+	// resumed load were not read: nothing is written
+	void Disable(const std::string& reason);
+
+	// Write collected levels to radon, returns number of rows written
+	int Save();
+
+   private:
+	struct level_stats
+	{
+		std::vector<double> min;
+		std::vector<double> max;
+		std::vector<double> mean;
+	};
+
+	// producer, geometry name, analysis time, level type, level value
+	typedef std::tuple<long, std::string, std::string, himan::HPLevelType, int> level_key;
+
+	// Index 0: pressure, 1: height
+	std::map<level_key, level_stats> itsLevels[2];
+	std::string itsDisabledReason;
+	std::mutex itsMutex;
+};
+}  // namespace grid_to_radon
@@ -1,5 +1,5 @@
 #include "logger.h"
-#include "record.h"
+#include "recordsink.h"
 #include <string>
 
 namespace grid_to_radon
@@ -10,7 +10,7 @@ class NetCDFLoader
 	NetCDFLoader();
 	~NetCDFLoader() = default;
 
-	std::pair<bool, records> Load(const std::string& theInfile) const;
+	bool Load(const std::string& theInfile, RecordSink& sink) const;
 
    private:
 	std::string itsHostName;
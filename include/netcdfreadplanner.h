@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+
+namespace grid_to_radon
+{
+enum class NetCDFReadOrder
+{
+	kTimeMajor,      // time -> parameter -> level
+	kParameterMajor  // parameter -> time -> level
+};
+
+// Inspects the on-disk layout of the data variables of a netcdf file
+// (format, record dimension, chunk shape) and decides in which order the
+// slices should be read, and how large chunk cache is needed so that each
+// chunk is decompressed only once. The chunk caches of all variables
+// together are limited to GRID_TO_RADON_NETCDF_CHUNK_CACHE_MB (default 256).
+//
+// netcdf takes the cache settings of each variable from the process-wide
+// defaults when the file is opened, so the planned settings are applied
+// only for opening the file and the earlier defaults restored after that.
+
+class NetCDFReadPlanner
+{
+   public:
+	NetCDFReadPlanner();
+	~NetCDFReadPlanner();
+
+	NetCDFReadPlanner(const NetCDFReadPlanner&) = delete;
+	NetCDFReadPlanner& operator=(const NetCDFReadPlanner&) = delete;
+
+	bool Plan(const std::string& theFileName);
+
+	// Set the chunk cache of each variable for files opened after this call
+	bool Apply();
+
+	// Restore the chunk cache settings that were in effect before Apply(),
+	// called also from the destructor
+	void Restore();
+
+	NetCDFReadOrder Order() const;
+	size_t CacheSize() const;
+	std::string ToString() const;
+
+   private:
+	NetCDFReadOrder itsOrder;
+	size_t itsCacheSize;
+	size_t itsCacheSlots;
+	size_t itsMaxCacheSize;
+	bool itsChunked;
+
+	// Settings before Apply()
+	bool itsApplied;
+	size_t itsPreviousSize;
+	size_t itsPreviousSlots;
+	float itsPreviousPreemption;
+};
+}  // namespace grid_to_radon
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+namespace grid_to_radon
+{
+namespace netcdfslice
+{
+// Identification of a 2D slice of a NetCDF variable that is registered
+// in-place (--in-place, s3), so that the slice can be read directly from the
+// original file:
+//
+//   file_location   file name, '#' and variable name, e.g. /data/ec.nc#t2m
+//   message_no      time index * kMaxLevels + level index of the variable
+//
+// Indexes are positions along the time and z dimensions of the variable;
+// level index is 0 when the variable has no z dimension.
+
+const unsigned long kMaxLevels = 65536;
+const unsigned long kMaxTimes = 32768;
+
+struct slice
+{
+	std::string file_name;
+	std::string variable;
+	unsigned long time_index;
+	unsigned long level_index;
+};
+
+// Returns nothing if the slice can not be identified: indexes are too large
+// or variable name is empty or contains '#'
+std::optional<std::string> FileLocation(const slice& s);
+std::optional<unsigned long> MessageNo(const slice& s);
+
+// Returns nothing if file location does not name a variable
+std::optional<slice> Decode(const std::string& fileLocation, unsigned long messageNo);
+}  // namespace netcdfslice
+}  // namespace grid_to_radon
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+namespace grid_to_radon
+{
+namespace netcdfwriter
+{
+struct write_stats
+{
+	size_t input_size = 0;   // bytes
+	size_t output_size = 0;  // bytes
+	size_t write_time = 0;   // ms
+	size_t read_time = 0;    // ms, time to read data variables back from output
+};
+
+// Returns true if compression or chunking is requested for netcdf output
+bool Enabled();
+
+// Copy netcdf file to NetCDF4 (classic model) file, applying compression,
+// shuffle filter and chunk shape to the data variables
+bool Repack(const std::string& inputFileName, const std::string& outputFileName, write_stats& stats);
+}  // namespace netcdfwriter
+}  // namespace grid_to_radon
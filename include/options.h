@@ -28,7 +28,35 @@ struct Options
 	      ss_table_name(""),
 	      allow_multi_table_gribs(false),
 	      metadata_file_name(),
-	      wait_timeout(0)
+	      wait_timeout(0),
+	      netcdf_compression("none"),
+	      netcdf_compression_level(-1),
+	      netcdf_shuffle(false),
+	      netcdf_chunk_shape(),
+	      tile_index_file_name(),
+	      skip_unchanged(false),
+	      checkpoint_dir(),
+	      checkpoint_interval(100),
+	      resume(false),
+	      grib2_ccsds(false),
+	      consolidated_output_dir(),
+	      adaptive_threads(false),
+	      max_db_concurrency(0),
+	      filter(),
+	      shard(),
+	      byte_range(),
+	      merge_metadata(false),
+	      incremental_ss_state(false),
+	      ss_state_quiet_period(30),
+	      ss_state_group_size(0),
+	      priority(),
+	      follow(false),
+	      follow_sentinel(),
+	      follow_idle_timeout(600),
+	      follow_message_count(0),
+	      direct_partition_insert(false),
+	      field_stats(false),
+	      hybrid_level_height(false)
 	{
 	}
 
@@ -39,19 +67,47 @@ struct Options
 	unsigned int producer;     // -p
 	std::string analysistime;  // -a
 	std::vector<std::string> infile;
-	std::string level;               // -L
-	bool use_level_value;            // --use-level-value
-	bool use_inverse_level_value;    // --use-inverse-level-value
-	int max_failures;                // --max-failures
-	int max_skipped;                 // --max-skipped
-	bool dry_run;                    // -d;
-	short threadcount;               // -j
-	bool ss_state_update;            // -X
-	bool in_place_insert;            // -I
-	std::string ss_table_name;       // --smartmet-server-table-name
-	bool allow_multi_table_gribs;    // --allow-multi-table-gribs
-	std::string metadata_file_name;  // --metadata-file-name, -m
-	unsigned int wait_timeout;       // --wait-timeout, -w
+	std::string level;                    // -L
+	bool use_level_value;                 // --use-level-value
+	bool use_inverse_level_value;         // --use-inverse-level-value
+	int max_failures;                     // --max-failures
+	int max_skipped;                      // --max-skipped
+	bool dry_run;                         // -d;
+	short threadcount;                    // -j
+	bool ss_state_update;                 // -X
+	bool in_place_insert;                 // -I
+	std::string ss_table_name;            // --smartmet-server-table-name
+	bool allow_multi_table_gribs;         // --allow-multi-table-gribs
+	std::string metadata_file_name;       // --metadata-file-name, -m
+	unsigned int wait_timeout;            // --wait-timeout, -w
+	std::string netcdf_compression;       // --netcdf-compression
+	int netcdf_compression_level;         // --netcdf-compression-level
+	bool netcdf_shuffle;                  // --netcdf-shuffle
+	std::string netcdf_chunk_shape;       // --netcdf-chunk-shape
+	std::string tile_index_file_name;     // --tile-index
+	bool skip_unchanged;                  // --skip-unchanged
+	std::string checkpoint_dir;           // --checkpoint-dir
+	unsigned int checkpoint_interval;     // --checkpoint-interval
+	bool resume;                          // --resume
+	bool grib2_ccsds;                     // --grib2-ccsds
+	std::string consolidated_output_dir;  // --consolidated-output-dir
+	bool adaptive_threads;                // -j auto
+	int max_db_concurrency;               // --max-db-concurrency
+	std::string filter;                   // --filter
+	std::string shard;                    // --shard
+	std::string byte_range;               // --byte-range
+	bool merge_metadata;                  // --merge-metadata
+	bool incremental_ss_state;            // --incremental-ss-state
+	unsigned int ss_state_quiet_period;   // --ss-state-quiet-period
+	size_t ss_state_group_size;           // --ss-state-group-size
+	std::string priority;                 // --priority
+	bool follow;                          // --follow
+	std::string follow_sentinel;          // --follow-sentinel
+	unsigned int follow_idle_timeout;     // --follow-idle-timeout
+	unsigned int follow_message_count;    // --follow-message-count
+	bool direct_partition_insert;         // --direct-partition-insert
+	bool field_stats;                     // --field-stats
+	bool hybrid_level_height;             // --hybrid-level-height
 };
 }  // namespace grid_to_radon
 
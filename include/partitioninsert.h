@@ -0,0 +1,53 @@
+#pragma once
+
+#include "record.h"
+#include <file_information.h>
+#include <info.h>
+#include <memory>
+#include <optional>
+#include <plugin_configuration.h>
+#include <string>
+#include <vector>
+
+namespace himan
+{
+namespace plugin
+{
+class radon;
+}
+}  // namespace himan
+
+namespace grid_to_radon
+{
+namespace partitioninsert
+{
+// Insert of grid rows directly into the partition of the analysis time
+// (--direct-partition-insert), so that the partitioning trigger created by
+// radon_tables.py is not run for every row. Partition is resolved from
+// as_grid once per producer, geometry and analysis time.
+//
+// Returns nothing when the row should be saved with the radon plugin
+// instead: partition does not exist, the row exists already (plugin
+// updates it) or the insert failed.
+
+std::optional<record> Save(std::shared_ptr<himan::configuration>& config, std::shared_ptr<himan::info<double>>& info,
+                           std::shared_ptr<himan::plugin::radon>& r, const himan::file_information& finfo);
+
+// Columns of a grid row, as written by radon::Save() of himan-plugins.
+// regression/partitioninsert_test checks them against the grid table schema
+// of the regression database.
+
+extern const std::vector<std::string> kColumns;
+
+// Insert statement of one row to a partition, with values in the order of
+// kColumns. regression/partitioninsert_test checks the value mapping.
+
+std::string InsertQuery(const std::string& schemaName, const std::string& partitionName, const record& rec,
+                        const himan::param& par, const himan::file_information& finfo);
+
+// Query that returns a row if the grid row of the record is still registered
+// to its file and the partition of its analysis time exists. Table name of
+// the record can be the table or the partition of as_grid.
+std::string ExistsQuery(const record& rec);
+}  // namespace partitioninsert
+}  // namespace grid_to_radon
@@ -1,43 +1,98 @@
 #pragma once
 
+#include "fieldstats.h"
 #include "forecast_time.h"
 #include "forecast_type.h"
 #include "level.h"
 #include "param.h"
 #include "producer.h"
+#include <string>
+#include <tuple>
+#include <vector>
 
 namespace grid_to_radon
 {
+// Handle to a string that is stored only once per process. Names of schemas,
+// tables, geometries and parameters repeat in nearly every record, so records
+// only hold a pointer to the shared copy. Interned strings are never released.
+
+class interned_string
+{
+   public:
+	interned_string();
+	explicit interned_string(const std::string& str);
+
+	const std::string& str() const
+	{
+		return *itsString;
+	}
+
+	operator const std::string&() const
+	{
+		return *itsString;
+	}
+
+   private:
+	const std::string* itsString;
+};
+
+// Metadata of one field loaded to radon. File name is unique to each field
+// in split mode, so it is not interned. Records are move-only.
+
 struct record
 {
-	std::string schema_name;
-	std::string table_name;
+	interned_string schema_name;
+	interned_string table_name;
 	std::string file_name;
 	himan::HPFileType file_type;
-	std::string geometry_name;
+	interned_string geometry_name;
 	int geometry_id;
-	himan::producer producer;
-	himan::forecast_type ftype;
-	himan::forecast_time ftime;
-	himan::level level;
-	himan::param param;
-	record() = default;
-	record(const std::string schema_name_, const std::string& table_name_, const std::string& file_name_, himan::HPFileType file_type_,
-	       const std::string& geometry_name_, int geometry_id_, const himan::producer& producer_, const himan::forecast_type ftype_,
-	       const himan::forecast_time ftime_, const himan::level level_, const himan::param param_)
-	    : schema_name(schema_name_),table_name(table_name_),
-	      file_name(file_name_),
-	      file_type(file_type_),
-	      geometry_name(geometry_name_),
-              geometry_id(geometry_id_),
-	      producer(producer_),
-	      ftype(ftype_),
-	      ftime(ftime_),
-	      level(level_),
-	      param(param_)
+	int producer_id;
+	himan::HPForecastType forecast_type_id;
+	double forecast_type_value;
+	interned_string analysis_time;    // sql format
+	interned_string forecast_period;  // %h:%02M:%02S
+	himan::HPLevelType level_type;
+	double level_value;
+	double level_value2;
+	int param_id;
+	interned_string param_name;
+	field_stats stats;  // --field-stats
+
+	record();
+	record(const std::string& schema_name_, const std::string& table_name_, const std::string& file_name_,
+	       himan::HPFileType file_type_, const std::string& geometry_name_, int geometry_id_,
+	       const himan::producer& producer_, const himan::forecast_type& ftype_, const himan::forecast_time& ftime_,
+	       const himan::level& level_, const himan::param& param_);
+
+	record(const record&) = delete;
+	record& operator=(const record&) = delete;
+	record(record&&) = default;
+	record& operator=(record&&) = default;
+};
+
+typedef std::vector<record> records;
+
+// Fields that identify one row of table ss_state
+struct ss_state_key
+{
+	long producer_id;
+	int geometry_id;
+	std::string analysis_time;
+	std::string forecast_period;
+	int forecast_type_id;
+	double forecast_type_value;
+	std::string schema_name;
+	std::string table_name;
+
+	bool operator<(const ss_state_key& other) const
 	{
+		return std::tie(producer_id, geometry_id, analysis_time, forecast_period, forecast_type_id,
+		                forecast_type_value, schema_name, table_name) <
+		       std::tie(other.producer_id, other.geometry_id, other.analysis_time, other.forecast_period,
+		                other.forecast_type_id, other.forecast_type_value, other.schema_name, other.table_name);
 	}
 };
 
-typedef std::vector<record> records;
-}
+typedef std::vector<ss_state_key> ss_state_keys;
+}  // namespace grid_to_radon
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "record.h"
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace grid_to_radon
+{
+// Receives records of successfully loaded fields as they are produced, so that
+// records of a run don't need to be held in memory until the end of the run.
+// Add() may be called from several threads.
+
+class RecordSink
+{
+   public:
+	virtual ~RecordSink() = default;
+	virtual void Add(const record& rec) = 0;
+};
+
+// Writes records to metadata file (json) as they arrive. File is written with
+// a temporary name and renamed when closed, so that a partial file is never
+// seen with the final name.
+
+class MetadataWriter : public RecordSink
+{
+   public:
+	explicit MetadataWriter(const std::string& theFileName);
+	~MetadataWriter();
+
+	MetadataWriter(const MetadataWriter&) = delete;
+	MetadataWriter& operator=(const MetadataWriter&) = delete;
+
+	void Add(const record& rec) override;
+	void Close();
+
+   private:
+	std::string itsFileName;
+	std::ofstream itsStream;
+	size_t itsCount;
+	std::mutex itsMutex;
+};
+
+// Collects unique ss_state keys and table names of the records of one input file
+
+class SSStateCollector : public RecordSink
+{
+   public:
+	void Add(const record& rec) override;
+	void Add(const ss_state_key& key);
+
+	ss_state_keys Keys() const;
+	std::set<std::string> Tables() const;
+
+   private:
+	std::set<ss_state_key> itsKeys;
+	std::set<std::string> itsTables;
+	mutable std::mutex itsMutex;
+};
+
+std::string RecordToJSON(const record& rec);
+
+// Read ss_state keys of records from metadata file, for merging the results
+// of shards loaded by separate processes
+ss_state_keys ReadSSStateKeys(const std::string& theFileName);
+}  // namespace grid_to_radon
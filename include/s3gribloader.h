@@ -1,6 +1,7 @@
 #pragma once
 
-#include "record.h"
+#include "hybridlevelheight.h"
+#include "recordsink.h"
 #include <string>
 
 namespace grid_to_radon
@@ -11,10 +12,12 @@ class S3GribLoader
 	S3GribLoader();
 	~S3GribLoader() = default;
 
-	std::pair<bool, records> Load(const std::string& theInfile) const;
+	// Statistics for table hybrid_level_height are added to hybridLevelHeight if given
+	bool Load(const std::string& theInfile, RecordSink& sink, HybridLevelHeight* hybridLevelHeight = nullptr) const;
 
    private:
-	records ReadFileStream(const std::string& theFileName, size_t startByte, size_t byteCount) const;
+	void ReadFileStream(const std::string& theFileName, size_t startByte, size_t byteCount, RecordSink& sink,
+	                    SSStateCollector& collected, HybridLevelHeight* hybridLevelHeight) const;
 
 	char* itsHost;
 	char* itsAccessKey;
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "recordsink.h"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace grid_to_radon
+{
+// Publishes ss_state rows while a file is being loaded (--incremental-ss-state),
+// so that the first forecast steps are visible before the whole file is done.
+//
+// Records are grouped by ss_state row (producer, geometry, analysis time,
+// forecast period, forecast type). A group is published when it has
+// --ss-state-group-size fields, or when no new field has arrived to it in
+// --ss-state-quiet-period seconds. Reaching the group size publishes a group
+// immediately only once; fields that arrive after that are published again
+// after the quiet period, or at Flush().
+
+class SSStatePublisher : public RecordSink
+{
+   public:
+	SSStatePublisher();
+	~SSStatePublisher();
+
+	SSStatePublisher(const SSStatePublisher&) = delete;
+	SSStatePublisher& operator=(const SSStatePublisher&) = delete;
+
+	void Start();
+	void Stop();
+
+	void Add(const record& rec) override;
+	void Add(const ss_state_key& key);
+
+	// Publish all groups with unpublished fields
+	void Flush();
+
+	size_t PublishedCount() const;
+
+   private:
+	struct group
+	{
+		size_t count = 0;
+		bool dirty = false;
+		bool completed = false;  // published because group size was reached
+		std::chrono::steady_clock::time_point last_update;
+	};
+
+	void Run();
+	void Publish(const ss_state_keys& keys);
+
+	std::map<ss_state_key, group> itsGroups;
+	size_t itsPublishedCount;
+	bool itsStopped;
+
+	mutable std::mutex itsMutex;
+	std::condition_variable itsCondition;
+	std::thread itsThread;
+};
+}  // namespace grid_to_radon
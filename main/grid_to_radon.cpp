@@ -1,17 +1,25 @@
+#include "common.h"
+#include "concurrencycontroller.h"
+#include "dbadmission.h"
 #include "geotiffloader.h"
+#include "gribfilter.h"
 #include "gribloader.h"
+#include "hybridlevelheight.h"
 #include "netcdfloader.h"
 #include "options.h"
+#include "recordsink.h"
 #include "s3.h"
 #include "s3gribloader.h"
 #include "unistd.h"
+#include <algorithm>
 #include <boost/program_options.hpp>
 #include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <fmt/chrono.h>
-#include <fstream>
 #include <iostream>
 #include <logger.h>
+#include <regex>
 #include <thread>
 #include <util.h>
 grid_to_radon::Options options;
@@ -32,6 +40,8 @@ bool parse_options(int argc, char* argv[])
 
 	int logLevel = -1;
 
+	std::string threads;
+
 	// clang-format off
 	desc.add_options()
 		("help,h", "print out help message")
@@ -50,7 +60,7 @@ bool parse_options(int argc, char* argv[])
 		("max-failures", po::value(&max_failures), "maximum number of allowed loading failures (grib) -1 = \"don't care\"")
 		("max-skipped", po::value(&max_skipped), "maximum number of allowed skipped messages (grib) -1 = \"don't care\"")
 		("dry-run", po::bool_switch(&options.dry_run), "dry run: no changes made to database or disk, to see sql set env variable FMIDB_DEBUG=1)")
-		("threads,j", po::value(&options.threadcount), "number of threads to use. only applicable to grib")
+		("threads,j", po::value(&threads), "number of threads to use, or 'auto' to adjust during run (grib). only applicable to grib and geotiff")
 		("no-ss_state-update,X", po::bool_switch(&no_ss_state_switch), "do not update ss_state table information")
 	        ("in-place,I", po::bool_switch(&options.in_place_insert), "do in-place insert (file not split and copied)")
 	        ("no-directory-structure-check", po::bool_switch(&no_directory_structure_check_switch), "DEPRECATED")
@@ -58,6 +68,33 @@ bool parse_options(int argc, char* argv[])
 		("allow-multi-table-gribs", po::bool_switch(&options.allow_multi_table_gribs), "allow single grib file messages to be loaded to more than one radon table (in-place insert)")
 		("metadata,m", po::value(&options.metadata_file_name), "write metadata of successful fields to this file (json)")
 		("wait-timeout,w", po::value(&options.wait_timeout), "wait for file to to appear for this many seconds (default: 0)")
+		("netcdf-compression", po::value(&options.netcdf_compression), "compression of netcdf output files: none, deflate, zstd (default: none)")
+		("netcdf-compression-level", po::value(&options.netcdf_compression_level), "compression level of netcdf output files (default: deflate 4, zstd 3)")
+		("netcdf-shuffle", po::bool_switch(&options.netcdf_shuffle), "use shuffle filter with netcdf output files")
+		("netcdf-chunk-shape", po::value(&options.netcdf_chunk_shape), "chunk shape of netcdf output files as YxX (default: whole grid)")
+		("tile-index", po::value(&options.tile_index_file_name), "write tile offsets of cloud-optimized geotiff bands to this file (json lines)")
+		("skip-unchanged", po::bool_switch(&options.skip_unchanged), "skip fields that are already registered with identical content (grib)")
+		("checkpoint-dir", po::value(&options.checkpoint_dir), "write progress checkpoints of each input file to this directory (grib, netcdf)")
+		("checkpoint-interval", po::value(&options.checkpoint_interval), "sync checkpoint to disk after this many completed fields (default: 100)")
+		("resume", po::bool_switch(&options.resume), "skip fields completed by an earlier run, according to checkpoint")
+		("grib2-ccsds", po::bool_switch(&options.grib2_ccsds), "repack simple packed grib2 messages with ccsds compression when splitting")
+		("consolidated-output-dir", po::value(&options.consolidated_output_dir), "append split grib messages to one file per producer, analysis time and geometry under this directory")
+		("max-db-concurrency", po::value(&options.max_db_concurrency), "maximum number of concurrent database operations of all grid_to_radon processes on this host (default: 0 = no limit)")
+		("filter", po::value(&options.filter), "load only grib messages whose keys match expression, eg. 'discipline=0,parameterCategory=0/1,endStep=0..24' (!= to exclude)")
+		("shard", po::value(&options.shard), "load only messages of shard i/N of grib file, i = 0..N-1 (ss_state is updated with --merge-metadata)")
+		("byte-range", po::value(&options.byte_range), "load only messages of grib file starting in byte range first-last, last exclusive")
+		("priority", po::value(&options.priority), "load grib messages in order of given keys instead of file order, eg. 'endStep,perturbationNumber' ('-' before key for descending order)")
+		("follow", po::bool_switch(&options.follow), "load grib file while it is being written, messages are loaded as they are completed")
+		("follow-sentinel", po::value(&options.follow_sentinel), "with --follow, end when this file exists and input file is read completely")
+		("follow-idle-timeout", po::value(&options.follow_idle_timeout), "with --follow, end when input file has not grown in this many seconds, 0 = never (default: 600)")
+		("follow-message-count", po::value(&options.follow_message_count), "with --follow, end after this many messages")
+		("direct-partition-insert", po::bool_switch(&options.direct_partition_insert), "insert grib fields directly to analysis time partition instead of through partitioning trigger")
+		("field-stats", po::bool_switch(&options.field_stats), "compute min, max, mean and missing count of each grib and netcdf field to metadata file")
+		("hybrid-level-height", po::bool_switch(&options.hybrid_level_height), "update table hybrid_level_height from hybrid level pressure and height fields of grib files")
+		("merge-metadata", po::bool_switch(&options.merge_metadata), "input files are metadata files of shards: update ss_state from them")
+		("incremental-ss-state", po::bool_switch(&options.incremental_ss_state), "update ss_state for each forecast step as soon as it is complete (grib)")
+		("ss-state-quiet-period", po::value(&options.ss_state_quiet_period), "with --incremental-ss-state, consider step complete when no new fields have arrived in this many seconds (default: 30)")
+		("ss-state-group-size", po::value(&options.ss_state_group_size), "with --incremental-ss-state, number of fields in each complete step (default: 0 = use quiet period only)")
 		;
 
 	// clang-format on
@@ -145,75 +182,184 @@ bool parse_options(int argc, char* argv[])
 			break;
 	}
 
+	if (threads == "auto")
+	{
+		// geotiff loader uses a fixed thread count, one per cpu
+		options.adaptive_threads = true;
+		options.threadcount = static_cast<short>(std::ceil(grid_to_radon::ConcurrencyController::CPULimit()));
+	}
+	else if (!threads.empty())
+	{
+		try
+		{
+			options.threadcount = static_cast<short>(std::stoi(threads));
+		}
+		catch (const std::exception&)
+		{
+			options.threadcount = 0;
+		}
+
+		if (options.threadcount < 1)
+		{
+			std::cerr << "Invalid thread count: " << threads << std::endl;
+			return false;
+		}
+	}
+
 	if (options.wait_timeout > 0 && options.wait_timeout < 10)
 	{
 		logr.Warning("wait_timeout minimum value is 10, changing");
 		options.wait_timeout = 10;
 	}
 
-	if (no_directory_structure_check_switch)
+	if (options.netcdf_compression != "none" && options.netcdf_compression != "deflate" &&
+	    options.netcdf_compression != "zstd")
 	{
-		logr.Info("Option --no-directory-structure-check is deprecated");
+		std::cerr << "Invalid netcdf compression: " << options.netcdf_compression << std::endl;
+		return false;
 	}
 
-	return true;
-}
+	// Level -1 selects the default of the compression
 
-// std::quoted is c++14
-std::string quoted(const std::string& v)
-{
-	return fmt::format("\"{}\"", v);
-}
+	const int compressionLevel = options.netcdf_compression_level;
 
-std::string RecordToJSON(const grid_to_radon::record& rec)
-{
-	// If this gets any more complicated an actual JSON
-	// library should be used?
+	if (compressionLevel != -1 &&
+	    ((options.netcdf_compression == "deflate" && (compressionLevel < 0 || compressionLevel > 9)) ||
+	     (options.netcdf_compression == "zstd" && (compressionLevel < -131072 || compressionLevel > 22))))
+	{
+		std::cerr << "Invalid netcdf compression level for " << options.netcdf_compression << ": "
+		          << compressionLevel << ", use 0-9 for deflate, up to 22 for zstd" << std::endl;
+		return false;
+	}
 
-	// clang-format off
-	std::string json = fmt::format("{{ {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {} }}",
-		quoted("schema_name"), quoted(rec.schema_name),
-		quoted("table_name"), quoted(rec.table_name),
-		quoted("file_name"), quoted(rec.file_name),
-		quoted("file_type"), fmt::underlying(rec.file_type),
-		quoted("geometry_name"), quoted(rec.geometry_name),
-		quoted("producer_id"), rec.producer.Id(),
-		quoted("forecast_type_id"), fmt::underlying(rec.ftype.Type()),
-		quoted("forecast_type_value"), rec.ftype.Value(),
-		quoted("analysis_time"), quoted(rec.ftime.OriginDateTime().ToSQLTime()),
-		quoted("forecast_period"), quoted(rec.ftime.Step().String("%h:%02M:%02S")),
-		quoted("level_id"), fmt::underlying(rec.level.Type()),
-		quoted("level_value"), rec.level.Value(),
-		quoted("level_value2"), rec.level.Value2(),
-		quoted("param_name"), quoted(rec.param.Name()));
-	// clang-format on
-	return json;
-}
+	if (!options.netcdf_chunk_shape.empty() &&
+	    !std::regex_match(options.netcdf_chunk_shape, std::regex("^[1-9][0-9]*x[1-9][0-9]*$")))
+	{
+		std::cerr << "Invalid netcdf chunk shape: " << options.netcdf_chunk_shape << ", use YxX" << std::endl;
+		return false;
+	}
 
-void WriteMetadata(const grid_to_radon::records& recs)
-{
-	if (options.metadata_file_name.empty())
+	if (options.in_place_insert &&
+	    std::find(options.infile.begin(), options.infile.end(), "-") != options.infile.end())
 	{
-		return;
+		std::cerr << "In-place insert is not possible with stdin" << std::endl;
+		return false;
 	}
 
-	const std::string VERSION = "20210505";
-	std::ofstream out(options.metadata_file_name);
+	if (options.grib2_ccsds && options.in_place_insert)
+	{
+		std::cerr << "--grib2-ccsds is not possible with in-place insert" << std::endl;
+		return false;
+	}
 
-	out << "{\n  " << quoted("version") << " : " << quoted(VERSION) << ", " << quoted("records") << " : [";
+	if (!options.consolidated_output_dir.empty() && options.in_place_insert)
+	{
+		std::cerr << "--consolidated-output-dir is not possible with in-place insert" << std::endl;
+		return false;
+	}
+
+	try
+	{
+		grid_to_radon::GribFilter filter(options.filter);
+	}
+	catch (const std::invalid_argument& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+
+	if (!options.shard.empty())
+	{
+		std::smatch what;
+
+		if (!std::regex_match(options.shard, what, std::regex("^([0-9]+)/([1-9][0-9]*)$")) ||
+		    std::stoul(what.str(1)) >= std::stoul(what.str(2)))
+		{
+			std::cerr << "Invalid shard: " << options.shard << ", use i/N with i = 0..N-1" << std::endl;
+			return false;
+		}
+	}
+
+	if (!options.byte_range.empty())
+	{
+		std::smatch what;
 
-	size_t i = 0;
-	for (const auto& rec : recs)
+		if (!std::regex_match(options.byte_range, what, std::regex("^([0-9]+)-([0-9]+)$")) ||
+		    std::stoul(what.str(1)) >= std::stoul(what.str(2)))
+		{
+			std::cerr << "Invalid byte range: " << options.byte_range << ", use first-last" << std::endl;
+			return false;
+		}
+	}
+
+	if (!options.shard.empty() && !options.byte_range.empty())
 	{
-		out << "    " << RecordToJSON(rec);
-		if (++i != recs.size())
-			out << ",\n";
+		std::cerr << "--shard and --byte-range are mutually exclusive" << std::endl;
+		return false;
 	}
 
-	out << "  ]\n}";
-	out.close();
+	if (!options.priority.empty() &&
+	    !std::regex_match(options.priority, std::regex("^-?[A-Za-z][A-Za-z0-9_]*(,-?[A-Za-z][A-Za-z0-9_]*)*$")))
+	{
+		std::cerr << "Invalid priority: " << options.priority << ", use comma separated list of grib keys" << std::endl;
+		return false;
+	}
 
-	logr.Info(fmt::format("Wrote metadata to '{}'", options.metadata_file_name));
+	if (options.follow)
+	{
+		if (options.netcdf || options.geotiff || grid_to_radon::common::Sharded() || !options.priority.empty())
+		{
+			std::cerr << "--follow is only possible for local grib files without --shard, --byte-range or --priority"
+			          << std::endl;
+			return false;
+		}
+
+		// Checkpoint is tied to the size and modification time of the input
+		// file, which change while the file is followed
+
+		if (options.resume)
+		{
+			std::cerr << "--follow and --resume are mutually exclusive" << std::endl;
+			return false;
+		}
+
+		if (options.follow_sentinel.empty() && options.follow_idle_timeout == 0 && options.follow_message_count == 0)
+		{
+			std::cerr << "--follow requires --follow-sentinel, --follow-idle-timeout or --follow-message-count"
+			          << std::endl;
+			return false;
+		}
+
+		// File type can not be determined from a file that might still be empty
+		options.grib = true;
+	}
+
+	if (options.resume && options.checkpoint_dir.empty())
+	{
+		std::cerr << "--resume requires --checkpoint-dir" << std::endl;
+		return false;
+	}
+
+	// Shards leave ss_state to the merge step, which reads only the metadata
+	// files; fields completed before the restart would not be in them
+
+	if (options.resume && grid_to_radon::common::Sharded())
+	{
+		std::cerr << "--resume is not possible with --shard or --byte-range" << std::endl;
+		return false;
+	}
+
+	if (options.checkpoint_interval == 0)
+	{
+		options.checkpoint_interval = 1;
+	}
+
+	if (no_directory_structure_check_switch)
+	{
+		logr.Info("Option --no-directory-structure-check is deprecated");
+	}
+
+	return true;
 }
 
 bool file_exists(const std::string& file)
@@ -246,7 +392,8 @@ bool file_exists(const std::string& file)
 
 	ch::milliseconds cum_sleep(0);
 
-	while (ch::duration_cast<ch::milliseconds>(ch::system_clock::now() - start) <= wait_timeout)
+	while (ch::duration_cast<ch::milliseconds>(ch::system_clock::now() - start) <= wait_timeout &&
+	       !grid_to_radon::common::StopRequested())
 	{
 		if (exists(file))
 		{
@@ -270,12 +417,58 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	if (options.merge_metadata)
+	{
+		grid_to_radon::ss_state_keys keys;
+
+		for (const std::string& infile : options.infile)
+		{
+			const auto fileKeys = grid_to_radon::ReadSSStateKeys(infile);
+			logr.Info(fmt::format("Read {} records from '{}'", fileKeys.size(), infile));
+			keys.insert(keys.end(), fileKeys.begin(), fileKeys.end());
+		}
+
+		grid_to_radon::common::UpdateSSState(keys);
+		return 0;
+	}
+
+	// Stopping between fields is useful only when the run can be resumed
+	// or when following a file that has no other end; otherwise signals
+	// keep their default action
+
+	if (!options.checkpoint_dir.empty() || options.follow)
+	{
+		grid_to_radon::common::InstallSignalHandlers();
+	}
+
 	int retval = 0;
 
-	grid_to_radon::records all_records;
+	grid_to_radon::MetadataWriter metadata(options.metadata_file_name);
+
+	// Hybrid level heights are aggregated over all input files of the run
+	// and written once at the end
+
+	std::unique_ptr<grid_to_radon::HybridLevelHeight> hybridLevelHeight;
+
+	if (options.hybrid_level_height)
+	{
+		hybridLevelHeight = std::make_unique<grid_to_radon::HybridLevelHeight>();
+	}
+
+	std::unique_ptr<grid_to_radon::TileIndexWriter> tileIndex;
+
+	if (!options.tile_index_file_name.empty())
+	{
+		tileIndex = std::make_unique<grid_to_radon::TileIndexWriter>(options.tile_index_file_name);
+	}
 
 	for (const std::string& infile : options.infile)
 	{
+		if (grid_to_radon::common::StopRequested())
+		{
+			break;
+		}
+
 		const bool isLocalFile = (infile.substr(0, 5) != "s3://");
 
 		if (!isLocalFile)
@@ -321,47 +514,46 @@ int main(int argc, char** argv)
 			type = himan::util::FileType(infile);
 		}
 
+		if (options.follow && options.s3)
+		{
+			logr.Error(fmt::format("Following is not possible for s3 objects: '{}'", infile));
+			retval = 1;
+			continue;
+		}
+
+		if (grid_to_radon::common::Sharded() && (infile == "-" || options.s3 || type == himan::kNetCDF ||
+		                                         type == himan::kGeoTIFF || options.netcdf || options.geotiff))
+		{
+			logr.Error(fmt::format("Sharding is only possible for local grib files: '{}'", infile));
+			retval = 1;
+			continue;
+		}
+
 		if (type == himan::kNetCDF || options.netcdf)
 		{
 			logr.Trace(fmt::format("File '{}' is NetCDF", infile));
 
-			if (options.in_place_insert)
-			{
-				logr.Error("In-place insert not possible for netcdf");
-				retval = 1;
-				continue;
-			}
-			else if (options.s3)
-			{
-				logr.Error("s3 loading not possible for netcdf");
-				retval = 1;
-				continue;
-			}
-
 			grid_to_radon::NetCDFLoader ncl;
-			const auto ret = ncl.Load(infile);
-			retval = static_cast<int>(!ret.first);
-			all_records.insert(std::end(all_records), std::begin(ret.second), std::end(ret.second));
+			retval = static_cast<int>(!ncl.Load(infile, metadata));
 		}
 		else if (type == himan::kGRIB1 || type == himan::kGRIB2 || type == himan::kGRIB || options.grib)
 		{
 			logr.Trace(fmt::format("File '{}' is GRIB", infile));
 
-			std::pair<bool, std::vector<grid_to_radon::record>> ret;
+			bool ret;
 
 			if (options.s3)
 			{
 				grid_to_radon::S3GribLoader ldr;
-				ret = ldr.Load(infile);
+				ret = ldr.Load(infile, metadata, hybridLevelHeight.get());
 			}
 			else
 			{
 				grid_to_radon::GribLoader ldr;
-				ret = ldr.Load(infile);
+				ret = ldr.Load(infile, metadata, hybridLevelHeight.get());
 			}
 
-			retval = static_cast<int>(!ret.first);
-			all_records.insert(std::end(all_records), std::begin(ret.second), std::end(ret.second));
+			retval = static_cast<int>(!ret);
 		}
 		else if (type == himan::kGeoTIFF || options.geotiff)
 		{
@@ -378,9 +570,7 @@ int main(int argc, char** argv)
 
 			options.in_place_insert = true;
 
-			const auto ret = g.Load(infile);
-			retval = static_cast<int>(!ret.first);
-			all_records.insert(std::end(all_records), std::begin(ret.second), std::end(ret.second));
+			retval = static_cast<int>(!g.Load(infile, metadata, tileIndex.get()));
 		}
 		else
 		{
@@ -389,13 +579,20 @@ int main(int argc, char** argv)
 		}
 
 		// early exit if needed
-		if (retval != 0)
+		if (retval != 0 || grid_to_radon::common::StopRequested())
 		{
-			WriteMetadata(all_records);
+			metadata.Close();
+			grid_to_radon::dbadmission::Report();
 			return retval;
 		}
 	}
 
-	WriteMetadata(all_records);
+	if (hybridLevelHeight && !grid_to_radon::common::StopRequested())
+	{
+		hybridLevelHeight->Save();
+	}
+
+	metadata.Close();
+	grid_to_radon::dbadmission::Report();
 	return retval;
 }
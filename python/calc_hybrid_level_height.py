@@ -56,7 +56,7 @@ def insert_to_radon(producer_id, geometry_name, analysis_time, data):
         maxp_stdev = round(statistics.stdev(p["max"]), 1)
         minh = round(min(h["min"]), 1)
         minh_stdev = round(statistics.stdev(h["min"]), 1)
-        maxh = round(min(h["max"]), 1)
+        maxh = round(max(h["max"]), 1)
         maxh_stdev = round(statistics.stdev(h["max"]), 1)
         aveh = round(statistics.mean(h["ave"]), 1)
         avep = round(statistics.mean(p["ave"]), 1)
@@ -27,6 +27,8 @@ BuildRequires:  libfmigrib-devel >= 25.6.17
 BuildRequires:  libfmidb-devel >= 24.4.18
 BuildRequires:  libfminc-devel >= 24.1.12
 BuildRequires:  eccodes-devel
+BuildRequires:  netcdf-devel
+BuildRequires:  xxhash-devel
 BuildRequires:  libs3-devel >= 4.1
 BuildRequires:  himan-lib >= 26.4.17
 BuildRequires:  himan-lib-devel >= 26.4.17
@@ -63,6 +65,7 @@ Requires:       %{boost}-program-options
 Requires:       %{boost}-iostreams
 Requires:	unixODBC
 Requires:	fmt-libs >= 12.1
+Requires:	xxhash-libs
 Requires:	geos313
 Requires:	proj97
 Provides:	radon_tables.py
@@ -99,6 +102,7 @@ rm -rf %{buildroot}
 %{_bindir}/previ_to_radon.py
 %{_bindir}/geom_to_radon.py
 %{_bindir}/calc_hybrid_level_height.py
+%doc sql/grid_to_radon_hash.sql
 
 %changelog
 * Wed Apr 24 2024 Ville Kuvaja <ville.kuvaja@fmi.fi> - 24.4.24-1.fmi
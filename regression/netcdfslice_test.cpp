@@ -0,0 +1,185 @@
+// Identify slices of a netcdf file as registered in-place and check that the
+// decoded identification reads the same slice back from the file
+
+#include "netcdfslice.h"
+#include "options.h"
+#include <cstdio>
+#include <netcdf.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+grid_to_radon::Options options;
+
+static const size_t kTimes = 3, kLevels = 4, kNy = 5, kNx = 6;
+
+static bool Fail(const std::string& what)
+{
+	fprintf(stderr, "netcdfslice_test: %s\n", what.c_str());
+	return false;
+}
+
+// Value of each grid point identifies variable, time, level and point
+
+static float Value(int var, size_t t, size_t z, size_t i)
+{
+	return static_cast<float>(var * 1000000 + t * 10000 + z * 100) + static_cast<float>(i);
+}
+
+static bool CreateInput(const std::string& fileName)
+{
+	int ncid, dims[4], t, t2m;
+
+	if (nc_create(fileName.c_str(), NC_CLOBBER, &ncid) != NC_NOERR)
+	{
+		return Fail("nc_create");
+	}
+
+	nc_def_dim(ncid, "time", kTimes, &dims[0]);
+	nc_def_dim(ncid, "z", kLevels, &dims[1]);
+	nc_def_dim(ncid, "y", kNy, &dims[2]);
+	nc_def_dim(ncid, "x", kNx, &dims[3]);
+	nc_def_var(ncid, "t", NC_FLOAT, 4, dims, &t);
+
+	const int dims2[] = {dims[0], dims[2], dims[3]};
+	nc_def_var(ncid, "t2m", NC_FLOAT, 3, dims2, &t2m);
+	nc_enddef(ncid);
+
+	std::vector<float> values(kTimes * kLevels * kNy * kNx);
+
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		const size_t point = i % (kNy * kNx);
+		values[i] = Value(1, i / (kLevels * kNy * kNx), (i / (kNy * kNx)) % kLevels, point);
+	}
+
+	int ret = nc_put_var_float(ncid, t, values.data());
+
+	values.resize(kTimes * kNy * kNx);
+
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		values[i] = Value(2, i / (kNy * kNx), 0, i % (kNy * kNx));
+	}
+
+	if (ret == NC_NOERR)
+	{
+		ret = nc_put_var_float(ncid, t2m, values.data());
+	}
+
+	nc_close(ncid);
+
+	return (ret == NC_NOERR) ? true : Fail("nc_put_var_float");
+}
+
+// Read slice named by registered file location and message number
+
+static bool ReadSlice(const std::string& fileLocation, unsigned long messageNo, std::vector<float>& values)
+{
+	const auto slice = grid_to_radon::netcdfslice::Decode(fileLocation, messageNo);
+
+	if (!slice)
+	{
+		return Fail("can not decode " + fileLocation + " " + std::to_string(messageNo));
+	}
+
+	int ncid, varid, ndims;
+
+	if (nc_open(slice->file_name.c_str(), NC_NOWRITE, &ncid) != NC_NOERR)
+	{
+		return Fail("can not open " + slice->file_name);
+	}
+
+	if (nc_inq_varid(ncid, slice->variable.c_str(), &varid) != NC_NOERR ||
+	    nc_inq_varndims(ncid, varid, &ndims) != NC_NOERR)
+	{
+		nc_close(ncid);
+		return Fail("variable " + slice->variable + " not found");
+	}
+
+	std::vector<size_t> start{slice->time_index}, count{1};
+
+	if (ndims == 4)
+	{
+		start.push_back(slice->level_index);
+		count.push_back(1);
+	}
+
+	start.insert(start.end(), {0, 0});
+	count.insert(count.end(), {kNy, kNx});
+
+	values.resize(kNy * kNx);
+
+	const int ret = nc_get_vara_float(ncid, varid, start.data(), count.data(), values.data());
+
+	nc_close(ncid);
+
+	return (ret == NC_NOERR) ? true : Fail("nc_get_vara_float");
+}
+
+static bool Check(const std::string& fileName, const std::string& variable, int var, size_t t, size_t z)
+{
+	using namespace grid_to_radon;
+
+	const netcdfslice::slice slice{fileName, variable, t, z};
+	const auto fileLocation = netcdfslice::FileLocation(slice);
+	const auto messageNo = netcdfslice::MessageNo(slice);
+
+	if (!fileLocation || !messageNo)
+	{
+		return Fail("can not identify slice of " + variable);
+	}
+
+	std::vector<float> values;
+
+	if (!ReadSlice(fileLocation.value(), messageNo.value(), values))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		if (values[i] != Value(var, t, z, i))
+		{
+			return Fail("wrong slice read for " + variable + " time " + std::to_string(t) + " level " +
+			            std::to_string(z));
+		}
+	}
+
+	return true;
+}
+
+int main()
+{
+	using grid_to_radon::netcdfslice::slice;
+
+	// '#' in the file name is allowed, it separates the variable name
+	const std::string fileName = "/tmp/netcdfslice_test_#" + std::to_string(getpid()) + ".nc";
+
+	bool ok = CreateInput(fileName);
+
+	for (size_t t = 0; ok && t < kTimes; t++)
+	{
+		for (size_t z = 0; ok && z < kLevels; z++)
+		{
+			ok = Check(fileName, "t", 1, t, z);
+		}
+
+		ok = ok && Check(fileName, "t2m", 2, t, 0);
+	}
+
+	// Slices that can not be identified
+
+	ok = ok && (!grid_to_radon::netcdfslice::FileLocation(slice{fileName, "a#b", 0, 0}) ||
+	            Fail("variable name with '#' accepted"));
+	ok = ok && (!grid_to_radon::netcdfslice::MessageNo(slice{fileName, "t", 0, 65536}) ||
+	            Fail("too large level index accepted"));
+	ok = ok && (!grid_to_radon::netcdfslice::Decode("/tmp/netcdfslice_test.nc", 0) ||
+	            Fail("file name without variable decoded"));
+
+	std::remove(fileName.c_str());
+
+	printf("netcdfslice_test: %s\n", ok ? "ok" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+// Repack a netcdf file with a record (unlimited) dimension and check that
+// all records of the data variable are copied
+
+#include "netcdfwriter.h"
+#include "options.h"
+#include <cstdio>
+#include <netcdf.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+grid_to_radon::Options options;
+
+static const size_t kTimes = 3, kNy = 4, kNx = 5;
+
+static bool Fail(const std::string& what)
+{
+	fprintf(stderr, "netcdfwriter_test: %s\n", what.c_str());
+	return false;
+}
+
+static bool CreateInput(const std::string& fileName, const std::vector<float>& values)
+{
+	int ncid, dims[3], varid;
+
+	if (nc_create(fileName.c_str(), NC_CLOBBER, &ncid) != NC_NOERR)
+	{
+		return Fail("nc_create");
+	}
+
+	nc_def_dim(ncid, "time", NC_UNLIMITED, &dims[0]);
+	nc_def_dim(ncid, "y", kNy, &dims[1]);
+	nc_def_dim(ncid, "x", kNx, &dims[2]);
+	nc_def_var(ncid, "t2m", NC_FLOAT, 3, dims, &varid);
+	nc_enddef(ncid);
+
+	const size_t start[] = {0, 0, 0}, count[] = {kTimes, kNy, kNx};
+	const int ret = nc_put_vara_float(ncid, varid, start, count, values.data());
+
+	nc_close(ncid);
+
+	return (ret == NC_NOERR) ? true : Fail("nc_put_vara_float");
+}
+
+static bool Compare(const std::string& fileName, const std::vector<float>& expected)
+{
+	int ncid, varid, unlimdim;
+	size_t times;
+
+	if (nc_open(fileName.c_str(), NC_NOWRITE, &ncid) != NC_NOERR || nc_inq_varid(ncid, "t2m", &varid) != NC_NOERR)
+	{
+		return Fail("output file or variable not found");
+	}
+
+	nc_inq_unlimdim(ncid, &unlimdim);
+	nc_inq_dimlen(ncid, unlimdim, &times);
+
+	std::vector<float> values(expected.size());
+	const size_t start[] = {0, 0, 0}, count[] = {kTimes, kNy, kNx};
+
+	const bool read = (times == kTimes && nc_get_vara_float(ncid, varid, start, count, values.data()) == NC_NOERR);
+
+	nc_close(ncid);
+
+	if (!read)
+	{
+		return Fail("expected " + std::to_string(kTimes) + " records, found " + std::to_string(times));
+	}
+
+	return (values == expected) ? true : Fail("values differ");
+}
+
+int main()
+{
+	const std::string input = "/tmp/netcdfwriter_test_" + std::to_string(getpid()) + ".nc";
+	const std::string output = input + ".out";
+
+	std::vector<float> values(kTimes * kNy * kNx);
+
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		values[i] = static_cast<float>(i) * 0.5f;
+	}
+
+	options.netcdf_compression = "deflate";
+	options.netcdf_shuffle = true;
+
+	grid_to_radon::netcdfwriter::write_stats stats;
+
+	const bool ok = CreateInput(input, values) &&
+	                (grid_to_radon::netcdfwriter::Repack(input, output, stats) || Fail("Repack")) &&
+	                Compare(output, values);
+
+	std::remove(input.c_str());
+	std::remove(output.c_str());
+
+	printf("netcdfwriter_test: %s\n", ok ? "ok" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+// Check the column mapping of the direct partition insert, and its columns
+// against the grid table schema of the regression database when one is
+// available (RADON_HOSTNAME, RADON_WETODB_PASSWORD)
+
+#include "options.h"
+#include "partitioninsert.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <map>
+#include <pqxx/pqxx>
+#include <string>
+#include <vector>
+
+grid_to_radon::Options options;
+
+static bool Fail(const std::string& what)
+{
+	fprintf(stderr, "partitioninsert_test: %s\n", what.c_str());
+	return false;
+}
+
+// Every column of the insert must exist in the grid table, and every column
+// that the table requires must be given. A grid table is found from as_grid.
+
+static bool CheckSchema()
+{
+	const char* host = getenv("RADON_HOSTNAME");
+	const char* password = getenv("RADON_WETODB_PASSWORD");
+
+	if (!host || !password)
+	{
+		printf("partitioninsert_test: no database, grid table schema not checked\n");
+		return true;
+	}
+
+	const char* database = getenv("RADON_DATABASENAME");
+	const char* port = getenv("RADON_PORT");
+	const auto& insertColumns = grid_to_radon::partitioninsert::kColumns;
+
+	try
+	{
+		pqxx::connection conn(fmt::format("host={} dbname={} port={} user=wetodb password={}", host,
+		                                  database ? database : "radon", port ? port : "5432", password));
+		pqxx::work txn(conn);
+
+		const auto table = txn.exec("SELECT schema_name, table_name FROM as_grid LIMIT 1");
+
+		if (table.empty())
+		{
+			return Fail("no grid tables in as_grid");
+		}
+
+		const std::string schemaName = table[0][0].c_str();
+		const std::string tableName = table[0][1].c_str();
+
+		const auto columns = txn.exec(fmt::format(
+		    "SELECT column_name, is_nullable = 'NO' AND column_default IS NULL FROM information_schema.columns "
+		    "WHERE table_schema = '{}' AND table_name = '{}'",
+		    schemaName, tableName));
+
+		std::vector<std::string> tableColumns;
+		bool ok = true;
+
+		for (const auto& row : columns)
+		{
+			const std::string name = row[0].c_str();
+			tableColumns.push_back(name);
+
+			if (row[1].as<bool>() && std::find(insertColumns.begin(), insertColumns.end(), name) == insertColumns.end())
+			{
+				ok = Fail(fmt::format("required column {} of {}.{} is not inserted", name, schemaName, tableName));
+			}
+		}
+
+		for (const auto& name : insertColumns)
+		{
+			if (std::find(tableColumns.begin(), tableColumns.end(), name) == tableColumns.end())
+			{
+				ok = Fail(fmt::format("inserted column {} not found from {}.{}", name, schemaName, tableName));
+			}
+		}
+
+		return ok;
+	}
+	catch (const std::exception& e)
+	{
+		return Fail(fmt::format("schema check failed: {}", e.what()));
+	}
+}
+
+// Split comma separated list, ignoring commas inside parentheses and quotes
+
+static std::vector<std::string> SplitList(const std::string& list)
+{
+	std::vector<std::string> ret(1);
+	int depth = 0;
+	bool quoted = false;
+
+	for (const char c : list)
+	{
+		if (c == '\'')
+		{
+			quoted = !quoted;
+		}
+		else if (!quoted && c == '(')
+		{
+			depth++;
+		}
+		else if (!quoted && c == ')')
+		{
+			depth--;
+		}
+		else if (!quoted && depth == 0 && c == ',')
+		{
+			ret.emplace_back();
+			continue;
+		}
+
+		if (ret.back().empty() && c == ' ')
+		{
+			continue;
+		}
+
+		ret.back() += c;
+	}
+
+	return ret;
+}
+
+// Returns the value of each column of the insert statement
+
+static std::map<std::string, std::string> Parse(const std::string& query, std::vector<std::string>& columns)
+{
+	const size_t columnsStart = query.find('(') + 1;
+	const size_t columnsEnd = query.find(')', columnsStart);
+	const size_t valuesStart = query.find("VALUES (") + 8;
+	const size_t valuesEnd = query.rfind(") ON CONFLICT");
+
+	columns = SplitList(query.substr(columnsStart, columnsEnd - columnsStart));
+	const auto values = SplitList(query.substr(valuesStart, valuesEnd - valuesStart));
+
+	std::map<std::string, std::string> ret;
+
+	for (size_t i = 0; i < columns.size() && i < values.size(); i++)
+	{
+		ret[columns[i]] = values[i];
+	}
+
+	return (columns.size() == values.size()) ? ret : std::map<std::string, std::string>();
+}
+
+static bool Check(const std::map<std::string, std::string>& row, const std::string& column, const std::string& expected)
+{
+	const auto it = row.find(column);
+
+	if (it == row.end())
+	{
+		return Fail(fmt::format("column {} missing", column));
+	}
+
+	if (it->second != expected)
+	{
+		return Fail(fmt::format("column {}: expected {}, got {}", column, expected, it->second));
+	}
+
+	return true;
+}
+
+static grid_to_radon::record MakeRecord()
+{
+	grid_to_radon::record rec;
+	rec.schema_name = grid_to_radon::interned_string("harmonie");
+	rec.table_name = grid_to_radon::interned_string("meps_2026");
+	rec.file_name = "/masala/data/meps.grib2";
+	rec.file_type = himan::kGRIB2;
+	rec.geometry_name = grid_to_radon::interned_string("MEPS2500D");
+	rec.geometry_id = 1097;
+	rec.producer_id = 260;
+	rec.forecast_type_id = himan::kEpsPerturbation;
+	rec.forecast_type_value = 3;
+	rec.analysis_time = grid_to_radon::interned_string("2026-10-19 06:00:00");
+	rec.forecast_period = grid_to_radon::interned_string("12:00:00");
+	rec.level_type = himan::kHybrid;
+	rec.level_value = 65;
+	rec.level_value2 = himan::kHPMissingValue;
+	rec.param_id = 4;
+	rec.param_name = grid_to_radon::interned_string("T-K");
+
+	return rec;
+}
+
+int main()
+{
+	const auto rec = MakeRecord();
+
+	himan::file_information finfo;
+	finfo.file_location = rec.file_name;
+	finfo.file_type = himan::kGRIB2;
+	finfo.storage_type = himan::kLocalFileSystem;
+	finfo.message_no = 7;
+	finfo.offset = 1024UL;
+	finfo.length = 2048UL;
+
+	std::vector<std::string> columns;
+	auto row = Parse(
+	    grid_to_radon::partitioninsert::InsertQuery("harmonie", "meps_2026_20261019", rec, himan::param(), finfo),
+	    columns);
+
+	bool ok = (columns == grid_to_radon::partitioninsert::kColumns) ||
+	          Fail(fmt::format("columns differ from kColumns: {}", fmt::join(columns, ",")));
+
+	ok = ok && Check(row, "producer_id", "260") && Check(row, "analysis_time", "'2026-10-19 06:00:00'") &&
+	     Check(row, "geometry_id", "1097") && Check(row, "param_id", "4") &&
+	     Check(row, "level_id", "(SELECT id FROM level WHERE name = upper('hybrid'))") &&
+	     Check(row, "level_value", "65") && Check(row, "level_value2", "-1") &&
+	     Check(row, "forecast_period", "'12:00:00'") &&
+	     Check(row, "forecast_type_id", fmt::format("{}", static_cast<int>(himan::kEpsPerturbation))) &&
+	     Check(row, "forecast_type_value", "3") && Check(row, "aggregation_id", "NULL") &&
+	     Check(row, "aggregation_period", "NULL") && Check(row, "processing_type_id", "NULL") &&
+	     Check(row, "file_location", "'/masala/data/meps.grib2'") && Check(row, "file_server", "NULL") &&
+	     Check(row, "file_format_id", fmt::format("{}", static_cast<int>(himan::kGRIB2))) &&
+	     Check(row, "file_protocol_id", fmt::format("{}", static_cast<int>(himan::kLocalFileSystem))) &&
+	     Check(row, "message_no", "7") && Check(row, "byte_offset", "1024") && Check(row, "byte_length", "2048");
+
+	// Split files are registered without message position
+
+	finfo.message_no = std::nullopt;
+	finfo.offset = std::nullopt;
+	finfo.length = std::nullopt;
+	finfo.file_server = "masala";
+
+	row = Parse(
+	    grid_to_radon::partitioninsert::InsertQuery("harmonie", "meps_2026_20261019", rec, himan::param(), finfo),
+	    columns);
+
+	ok = ok && Check(row, "message_no", "NULL") && Check(row, "byte_offset", "NULL") &&
+	     Check(row, "byte_length", "NULL") && Check(row, "file_server", "'masala'");
+
+	// Registration check of unchanged fields (--skip-unchanged) uses the same values
+
+	const auto exists = grid_to_radon::partitioninsert::ExistsQuery(rec);
+
+	for (const std::string& condition :
+	     {"FROM harmonie.meps_2026 g", "g.level_id = (SELECT id FROM level WHERE name = upper('hybrid'))",
+	      "g.level_value2 = -1", "g.forecast_period = '12:00:00'", "g.file_location = '/masala/data/meps.grib2'"})
+	{
+		ok = ok && (exists.find(condition) != std::string::npos ||
+		            Fail(fmt::format("condition {} missing from {}", condition, exists)));
+	}
+
+	ok = CheckSchema() && ok;
+
+	printf("partitioninsert_test: %s\n", ok ? "ok" : "FAILED");
+
+	return ok ? 0 : 1;
+}
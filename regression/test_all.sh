@@ -0,0 +1,12 @@
+#!/bin/sh
+#
+# Run test programs built with 'scons-3 --debug-build tests'
+#
+
+set -e
+
+BUILD_DIR=../build/debug
+
+for t in netcdfwriter_test partitioninsert_test netcdfslice_test; do
+	$BUILD_DIR/$t
+done
@@ -0,0 +1,239 @@
+#include "checkpoint.h"
+#include "common.h"
+#include "logger.h"
+#include "options.h"
+#include <boost/algorithm/string.hpp>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <xxhash.h>
+
+extern grid_to_radon::Options options;
+
+using namespace grid_to_radon;
+
+// Header identifies the input file: if it has changed since the checkpoint
+// was written, the checkpoint is not used
+
+static std::string Header(const std::string& theInputFileName)
+{
+	namespace fs = std::filesystem;
+
+	const auto mtime = fs::last_write_time(theInputFileName).time_since_epoch().count();
+
+	return fmt::format("grid_to_radon checkpoint v1 {} {} {}", theInputFileName, fs::file_size(theInputFileName),
+	                   mtime);
+}
+
+Checkpoint::Checkpoint(const std::string& theInputFileName) : itsFileName(), itsFd(-1), itsPendingCount(0)
+{
+	if (options.checkpoint_dir.empty() || theInputFileName == "-" || options.s3)
+	{
+		return;
+	}
+
+	himan::logger logr("checkpoint");
+
+	const std::string inputFileName = common::CanonicalFileName(theInputFileName);
+	const std::string header = Header(inputFileName);
+
+	// Shards of the same file keep separate checkpoints
+
+	std::string part;
+
+	if (common::Sharded())
+	{
+		const auto range = common::ShardRange(std::filesystem::file_size(inputFileName));
+		part = fmt::format("_{}-{}", range.first, range.second);
+	}
+
+	itsFileName = fmt::format("{}/{:016x}_{}{}.checkpoint", options.checkpoint_dir,
+	                          XXH3_64bits(inputFileName.data(), inputFileName.size()),
+	                          std::filesystem::path(inputFileName).filename().string(), part);
+
+	if (options.resume && std::filesystem::exists(itsFileName))
+	{
+		Read(header);
+	}
+
+	std::filesystem::create_directories(options.checkpoint_dir);
+
+	const bool append = !itsResumed.empty();
+
+	itsFd = open(itsFileName.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+
+	if (itsFd == -1)
+	{
+		logr.Error(fmt::format("Unable to open checkpoint file '{}', checkpointing disabled", itsFileName));
+		itsFileName.clear();
+		return;
+	}
+
+	if (!append)
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+		itsPending = header + "\n";
+		itsPendingCount = 1;
+	}
+
+	logr.Debug(fmt::format("Using checkpoint file '{}'", itsFileName));
+}
+
+Checkpoint::~Checkpoint()
+{
+	if (itsFd != -1)
+	{
+		Flush();
+		close(itsFd);
+	}
+}
+
+bool Checkpoint::Enabled() const
+{
+	return itsFd != -1;
+}
+
+void Checkpoint::Read(const std::string& header)
+{
+	himan::logger logr("checkpoint");
+
+	std::ifstream in(itsFileName);
+	std::stringstream ss;
+	ss << in.rdbuf();
+
+	std::string contents = ss.str();
+
+	// Last line might have been written only partially
+	contents = contents.substr(0, contents.rfind('\n') + 1);
+
+	std::vector<std::string> lines;
+	boost::split(lines, contents, boost::is_any_of("\n"));
+
+	if (lines.empty() || lines[0] != header)
+	{
+		logr.Warning(fmt::format("Checkpoint file '{}' does not match input file, starting from beginning", itsFileName));
+		return;
+	}
+
+	for (size_t i = 1; i < lines.size(); i++)
+	{
+		std::vector<std::string> fields;
+		boost::split(fields, lines[i], boost::is_any_of("\t"));
+
+		if (fields.size() == 1 && !fields[0].empty())
+		{
+			itsResumed[fields[0]] = std::nullopt;
+		}
+		else if (fields.size() == 9)
+		{
+			itsResumed[fields[0]] = ss_state_key{std::stol(fields[1]), std::stoi(fields[2]), fields[3], fields[4],
+			                                     std::stoi(fields[5]), std::stod(fields[6]), fields[7], fields[8]};
+		}
+	}
+
+	logr.Info(fmt::format("Resuming with {} completed items from '{}'", itsResumed.size(), itsFileName));
+}
+
+bool Checkpoint::IsDone(const std::string& item) const
+{
+	return itsResumed.count(item) > 0;
+}
+
+void Checkpoint::Done(const std::string& item)
+{
+	if (Enabled())
+	{
+		Append(item + "\n");
+	}
+}
+
+void Checkpoint::Done(const std::string& item, const record& rec)
+{
+	if (!Enabled())
+	{
+		return;
+	}
+
+	const auto key = common::MakeSSStateKey(rec);
+
+	Append(fmt::format("{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\n", item, key.producer_id, key.geometry_id,
+	                   key.analysis_time, key.forecast_period, key.forecast_type_id, key.forecast_type_value,
+	                   key.schema_name, key.table_name));
+}
+
+void Checkpoint::Append(const std::string& line)
+{
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	itsPending += line;
+
+	if (++itsPendingCount < options.checkpoint_interval)
+	{
+		return;
+	}
+
+	if (write(itsFd, itsPending.data(), itsPending.size()) == static_cast<ssize_t>(itsPending.size()))
+	{
+		fdatasync(itsFd);
+	}
+
+	itsPending.clear();
+	itsPendingCount = 0;
+}
+
+void Checkpoint::Flush()
+{
+	if (!Enabled())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	if (!itsPending.empty() &&
+	    write(itsFd, itsPending.data(), itsPending.size()) == static_cast<ssize_t>(itsPending.size()))
+	{
+		fdatasync(itsFd);
+	}
+
+	itsPending.clear();
+	itsPendingCount = 0;
+}
+
+void Checkpoint::Remove()
+{
+	if (!Enabled())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	close(itsFd);
+	itsFd = -1;
+	itsPending.clear();
+
+	unlink(itsFileName.c_str());
+}
+
+size_t Checkpoint::ResumedCount() const
+{
+	return itsResumed.size();
+}
+
+ss_state_keys Checkpoint::ResumedKeys() const
+{
+	ss_state_keys keys;
+
+	for (const auto& item : itsResumed)
+	{
+		if (item.second)
+		{
+			keys.push_back(item.second.value());
+		}
+	}
+
+	return keys;
+}
@@ -1,18 +1,34 @@
 #include "common.h"
+#include "dbadmission.h"
 #include "filename.h"
 #include "options.h"
+#include "partitioninsert.h"
 #include "util.h"
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstring>
 #include <filesystem>
+#include <mutex>
 #include <plugin_factory.h>
 #include <regex>
+#include <shared_mutex>
 #include <sstream>
+#include <unordered_set>
+#include <xxhash.h>
 
 #define HIMAN_AUXILIARY_INCLUDE
 #include "radon.h"
 #undef HIMAN_AUXILIARY_INCLUDE
 
 extern grid_to_radon::Options options;
-std::mutex dirCreateMutex;
+
+// Directories known to exist, shared by all loaders and threads. Most messages
+// go to a small set of directories, so the set is checked under a shared lock
+// before touching the file system.
+
+std::shared_mutex knownDirectoriesMutex;
+std::unordered_set<std::string> knownDirectories;
 
 bool CheckDirectoryStructure(const std::filesystem::path& pathname);
 
@@ -103,17 +119,30 @@ void grid_to_radon::common::CreateDirectory(const std::string& theFileName)
 {
 	namespace fs = std::filesystem;
 
-	fs::path pathname(theFileName);
+	const std::string dirName = fs::path(theFileName).parent_path().string();
 
-	if (!fs::is_directory(pathname.parent_path()))
 	{
-		std::lock_guard<std::mutex> lock(dirCreateMutex);
+		std::shared_lock<std::shared_mutex> lock(knownDirectoriesMutex);
 
-		if (!fs::is_directory(pathname.parent_path()))
+		if (knownDirectories.count(dirName) > 0)
 		{
-			fs::create_directories(pathname.parent_path());
+			return;
 		}
 	}
+
+	std::unique_lock<std::shared_mutex> lock(knownDirectoriesMutex);
+
+	if (knownDirectories.count(dirName) > 0)
+	{
+		return;
+	}
+
+	if (!fs::is_directory(dirName))
+	{
+		fs::create_directories(dirName);
+	}
+
+	knownDirectories.insert(dirName);
 }
 
 grid_to_radon::record Merge(std::shared_ptr<himan::configuration>& config, std::shared_ptr<himan::info<double>>& info,
@@ -128,6 +157,18 @@ std::pair<bool, grid_to_radon::record> grid_to_radon::common::SaveToDatabase(
     std::shared_ptr<himan::configuration>& config, std::shared_ptr<himan::info<double>>& info,
     std::shared_ptr<himan::plugin::radon>& r, const himan::file_information& finfo)
 {
+	dbadmission::Slot slot;
+
+	if (options.direct_partition_insert && !options.dry_run)
+	{
+		auto rec = partitioninsert::Save(config, info, r, finfo);
+
+		if (rec)
+		{
+			return std::make_pair(true, std::move(rec.value()));
+		}
+	}
+
 	auto ret = r->Save<double>(*info, finfo, "", options.dry_run);
 
 	if (ret.first)
@@ -138,7 +179,39 @@ std::pair<bool, grid_to_radon::record> grid_to_radon::common::SaveToDatabase(
 	return std::make_pair(false, grid_to_radon::record());
 }
 
+grid_to_radon::ss_state_key grid_to_radon::common::MakeSSStateKey(const grid_to_radon::record& rec)
+{
+	double ftypeValue = rec.forecast_type_value;
+
+	if (ftypeValue == himan::kHPMissingValue)
+	{
+		ftypeValue = -1;
+	}
+
+	return grid_to_radon::ss_state_key{rec.producer_id,
+	                                   rec.geometry_id,
+	                                   rec.analysis_time,
+	                                   rec.forecast_period,
+	                                   static_cast<int>(rec.forecast_type_id),
+	                                   ftypeValue,
+	                                   rec.schema_name,
+	                                   rec.table_name};
+}
+
 void grid_to_radon::common::UpdateSSState(const grid_to_radon::records& recs)
+{
+	grid_to_radon::ss_state_keys keys;
+	keys.reserve(recs.size());
+
+	for (const grid_to_radon::record& rec : recs)
+	{
+		keys.push_back(MakeSSStateKey(rec));
+	}
+
+	UpdateSSState(keys);
+}
+
+void grid_to_radon::common::UpdateSSState(const grid_to_radon::ss_state_keys& keys)
 {
 	if (!options.ss_state_update)
 	{
@@ -152,21 +225,16 @@ void grid_to_radon::common::UpdateSSState(const grid_to_radon::records& recs)
 	std::set<std::string> handled;
 	int skippedCount = 0;
 
-	for (const grid_to_radon::record& rec : recs)
+	for (const grid_to_radon::ss_state_key& key : keys)
 	{
-		const std::string atime = rec.ftime.OriginDateTime().ToSQLTime();
-		const std::string period = rec.ftime.Step().String("%h:%02M:%02S");
-
-		double ftypeValue = rec.ftype.Value();
+		const std::string& atime = key.analysis_time;
+		const std::string& period = key.forecast_period;
+		const double ftypeValue = key.forecast_type_value;
 
-		if (ftypeValue == himan::kHPMissingValue)
-		{
-			ftypeValue = -1;
-		}
-		const std::string uniqueId = fmt::format("{}_{}_{}_{}_{}_{}", rec.producer.Id(), rec.geometry_id, atime, period,
-		                                         fmt::underlying(rec.ftype.Type()), ftypeValue);
+		const std::string uniqueId = fmt::format("{}_{}_{}_{}_{}_{}", key.producer_id, key.geometry_id, atime, period,
+		                                         key.forecast_type_id, ftypeValue);
 
-		if (std::find(handled.begin(), handled.end(), uniqueId) != handled.end())
+		if (handled.count(uniqueId) > 0)
 		{
 			skippedCount++;
 			continue;
@@ -178,20 +246,24 @@ void grid_to_radon::common::UpdateSSState(const grid_to_radon::records& recs)
 
 		if (table_name.empty())
 		{
-			table_name = fmt::format("{}.{}", rec.schema_name, rec.table_name);
+			table_name = fmt::format("{}.{}", key.schema_name, key.table_name);
 		}
 
 		std::string query = fmt::format(
 		    "INSERT INTO ss_state (producer_id, geometry_id, analysis_time, forecast_period, forecast_type_id,"
 		    "forecast_type_value, table_name) VALUES ({}, {}, '{}', '{}', {}, {}, '{}')",
-		    rec.producer.Id(), rec.geometry_id, atime, period, fmt::underlying(rec.ftype.Type()), ftypeValue,
-		    table_name);
+		    key.producer_id, key.geometry_id, atime, period, key.forecast_type_id, ftypeValue, table_name);
 
 		if (options.dry_run)
 		{
 			continue;
 		}
 
+		// Slot is taken per row, so that the latency seen by admission
+		// control is that of a single statement
+
+		dbadmission::Slot slot;
+
 		try
 		{
 			ldr->RadonDB().Execute(query);
@@ -204,8 +276,7 @@ void grid_to_radon::common::UpdateSSState(const grid_to_radon::records& recs)
 				    "UPDATE ss_state SET last_updated = now(), table_name = '{}' WHERE producer_id = {} AND "
 				    "geometry_id = {} AND analysis_time = '{}' AND forecast_period = '{}' AND forecast_type_id = {} "
 				    "AND forecast_type_value = {}",
-				    table_name, rec.producer.Id(), rec.geometry_id, atime, period, fmt::underlying(rec.ftype.Type()),
-				    ftypeValue);
+				    table_name, key.producer_id, key.geometry_id, atime, period, key.forecast_type_id, ftypeValue);
 				ldr->RadonDB().Execute(query);
 			}
 #if PQXX_VERSION_MAJOR < 7
@@ -224,3 +295,144 @@ void grid_to_radon::common::UpdateSSState(const grid_to_radon::records& recs)
 
 	logr.Trace(fmt::format("Skipped {} duplicate ss_state entries", skippedCount));
 }
+
+uint64_t grid_to_radon::common::HashMessage(const std::vector<unsigned char>& data)
+{
+	return XXH3_64bits(data.data(), data.size());
+}
+
+std::string grid_to_radon::common::HashKey(std::shared_ptr<himan::configuration>& config,
+                                           std::shared_ptr<himan::info<double>>& info)
+{
+	const auto& par = info->Param();
+
+	return fmt::format("{}/{}/{}/{}/{}/{}/{}/{}/{}/{}/{}/{}/{}", info->Producer().Id(),
+	                   info->Time().OriginDateTime().ToSQLTime(), info->Time().Step().String("%h:%02M:%02S"),
+	                   par.Name(), fmt::underlying(par.Aggregation().Type()), par.ProcessingType(),
+	                   fmt::underlying(info->Level().Type()), info->Level().Value(), info->Level().Value2(),
+	                   fmt::underlying(info->ForecastType().Type()), info->ForecastType().Value(),
+	                   config->TargetGeomName(), fmt::underlying(config->OutputFileType()));
+}
+
+// Hashes are stored in table grid_to_radon_hash, see sql/grid_to_radon_hash.sql.
+// Returns the earlier registration of the field if its data has not changed.
+
+std::optional<grid_to_radon::record> grid_to_radon::common::FindUnchanged(
+    std::shared_ptr<himan::configuration>& config, std::shared_ptr<himan::info<double>>& info,
+    std::shared_ptr<himan::plugin::radon>& r, const std::string& key, uint64_t hash, const std::string& fileLocation)
+{
+	r->RadonDB().Query(fmt::format(
+	    "SELECT hash, file_location, schema_name, table_name, geometry_id FROM grid_to_radon_hash WHERE key = '{}'",
+	    key));
+
+	const auto row = r->RadonDB().FetchRow();
+
+	if (row.empty() || std::stoll(row[0]) != static_cast<int64_t>(hash))
+	{
+		return std::nullopt;
+	}
+
+	// With in-place insert the registration must point to the same file,
+	// otherwise identical data in a new file is registered again
+
+	if (options.in_place_insert && row[1] != fileLocation)
+	{
+		return std::nullopt;
+	}
+
+	// Row saved before registration details were stored
+
+	if (row[2].empty() || row[3].empty() || row[4].empty())
+	{
+		return std::nullopt;
+	}
+
+	grid_to_radon::record rec(row[2], row[3], row[1], config->OutputFileType(), config->TargetGeomName(),
+	                          std::stoi(row[4]), info->Producer(), info->ForecastType(), info->Time(), info->Level(),
+	                          info->Param());
+
+	// Registration or partition might have been removed on the radon side
+	// since the hash was saved; the field is loaded again then
+
+	r->RadonDB().Query(partitioninsert::ExistsQuery(rec));
+
+	if (r->RadonDB().FetchRow().empty())
+	{
+		himan::logger logr("common");
+		logr.Debug(fmt::format("Registration of unchanged field {} not found from radon", key));
+		return std::nullopt;
+	}
+
+	return rec;
+}
+
+void grid_to_radon::common::SaveHash(std::shared_ptr<himan::plugin::radon>& r, const std::string& key, uint64_t hash,
+                                     const grid_to_radon::record& rec)
+{
+	if (options.dry_run)
+	{
+		return;
+	}
+
+	r->RadonDB().Execute(fmt::format(
+	    "INSERT INTO grid_to_radon_hash (key, hash, file_location, schema_name, table_name, geometry_id) VALUES "
+	    "('{}', {}, '{}', '{}', '{}', {}) ON CONFLICT (key) DO UPDATE SET hash = EXCLUDED.hash, file_location = "
+	    "EXCLUDED.file_location, schema_name = EXCLUDED.schema_name, table_name = EXCLUDED.table_name, geometry_id "
+	    "= EXCLUDED.geometry_id, last_updated = now()",
+	    key, static_cast<int64_t>(hash), rec.file_name, rec.schema_name.str(), rec.table_name.str(),
+	    rec.geometry_id));
+}
+
+static std::atomic<bool> stopRequested(false);
+
+static void SignalHandler(int signum)
+{
+	stopRequested = true;
+}
+
+void grid_to_radon::common::InstallSignalHandlers()
+{
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SignalHandler;
+	sa.sa_flags = SA_RESETHAND;
+	sigemptyset(&sa.sa_mask);
+
+	sigaction(SIGTERM, &sa, nullptr);
+	sigaction(SIGINT, &sa, nullptr);
+}
+
+bool grid_to_radon::common::StopRequested()
+{
+	return stopRequested;
+}
+
+bool grid_to_radon::common::Sharded()
+{
+	return (!options.shard.empty() || !options.byte_range.empty());
+}
+
+// Returns byte range [first, second) of the file; messages starting inside
+// the range belong to this shard. Shard is given as i/N with i = 0..N-1,
+// byte range as first-last with last exclusive.
+
+std::pair<size_t, size_t> grid_to_radon::common::ShardRange(size_t fileSize)
+{
+	if (!options.shard.empty())
+	{
+		const auto pos = options.shard.find('/');
+		const size_t i = std::stoul(options.shard.substr(0, pos));
+		const size_t n = std::stoul(options.shard.substr(pos + 1));
+
+		return std::make_pair(fileSize * i / n, fileSize * (i + 1) / n);
+	}
+
+	if (!options.byte_range.empty())
+	{
+		const auto pos = options.byte_range.find('-');
+		return std::make_pair(std::stoul(options.byte_range.substr(0, pos)),
+		                      std::min(fileSize, std::stoul(options.byte_range.substr(pos + 1))));
+	}
+
+	return std::make_pair(0, fileSize);
+}
@@ -0,0 +1,256 @@
+#include "concurrencycontroller.h"
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fmt/format.h>
+#include <fstream>
+
+using namespace grid_to_radon;
+
+// Length of one measurement interval
+static const std::chrono::seconds kInterval(5);
+
+// Change in throughput smaller than this is considered noise
+static const double kTolerance = 0.05;
+
+static double ProcessCPUTime()
+{
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+
+double ConcurrencyController::CPULimit()
+{
+	const double cpus = std::max(1u, std::thread::hardware_concurrency());
+
+	// cgroup v2: "max 100000" or "<quota> <period>"
+
+	std::ifstream v2("/sys/fs/cgroup/cpu.max");
+
+	if (v2)
+	{
+		std::string quota;
+		double period;
+
+		if (v2 >> quota >> period && quota != "max" && period > 0)
+		{
+			return std::min(cpus, std::stod(quota) / period);
+		}
+
+		return cpus;
+	}
+
+	// cgroup v1: quota is -1 if not set
+
+	std::ifstream quotaFile("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+	std::ifstream periodFile("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+
+	double quota, period;
+
+	if (quotaFile >> quota && periodFile >> period && quota > 0 && period > 0)
+	{
+		return std::min(cpus, quota / period);
+	}
+
+	return cpus;
+}
+
+ConcurrencyController::ConcurrencyController(bool enabled)
+    : itsEnabled(enabled),
+      itsMaxWorkers(1),
+      itsActive(1),
+      itsFinished(false),
+      itsStopped(false),
+      itsCompleted(0),
+      itsTimedCount(0),
+      itsMetadataTime(0),
+      itsWriteTime(0),
+      itsDatabaseTime(0)
+{
+	if (itsEnabled)
+	{
+		// Workers spend most of their time waiting for database and disk,
+		// so allow more workers than there are cpus
+
+		itsMaxWorkers = static_cast<short>(std::min(64.0, std::max(2.0, 4 * std::ceil(CPULimit()))));
+		itsActive = std::min<short>(2, itsMaxWorkers);
+	}
+}
+
+ConcurrencyController::~ConcurrencyController()
+{
+	Stop();
+}
+
+bool ConcurrencyController::Enabled() const
+{
+	return itsEnabled;
+}
+
+short ConcurrencyController::MaxWorkers() const
+{
+	return itsMaxWorkers;
+}
+
+short ConcurrencyController::Active() const
+{
+	return itsActive;
+}
+
+void ConcurrencyController::Start()
+{
+	if (itsEnabled)
+	{
+		itsThread = std::thread(&ConcurrencyController::Run, this);
+	}
+}
+
+void ConcurrencyController::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+		itsStopped = true;
+		itsFinished = true;
+	}
+
+	itsControllerCondition.notify_all();
+	itsWorkerCondition.notify_all();
+
+	if (itsThread.joinable())
+	{
+		itsThread.join();
+	}
+}
+
+void ConcurrencyController::WaitActive(short threadId)
+{
+	if (!itsEnabled || threadId < itsActive)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(itsMutex);
+	itsWorkerCondition.wait(lock, [&]() { return itsFinished || threadId < itsActive; });
+}
+
+void ConcurrencyController::Finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+		itsFinished = true;
+	}
+
+	itsWorkerCondition.notify_all();
+}
+
+void ConcurrencyController::Completed()
+{
+	itsCompleted++;
+}
+
+void ConcurrencyController::StageTimes(size_t metadataTime, size_t writeTime, size_t databaseTime)
+{
+	itsTimedCount++;
+	itsMetadataTime += metadataTime;
+	itsWriteTime += writeTime;
+	itsDatabaseTime += databaseTime;
+}
+
+void ConcurrencyController::Run()
+{
+	himan::logger logr("concurrency");
+
+	const double cpuLimit = CPULimit();
+
+	logr.Info(fmt::format("Adaptive worker count: start with {}, maximum {}, cpu limit {:.1f}",
+	                      static_cast<int>(itsActive), itsMaxWorkers, cpuLimit));
+
+	int direction = 1;
+	double previousThroughput = 0;
+
+	auto previousTime = std::chrono::steady_clock::now();
+	double previousCPUTime = ProcessCPUTime();
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(itsMutex);
+
+			if (itsControllerCondition.wait_for(lock, kInterval, [&]() { return itsStopped || itsFinished; }))
+			{
+				break;
+			}
+		}
+
+		const auto now = std::chrono::steady_clock::now();
+		const double cpuTime = ProcessCPUTime();
+		const double elapsed = std::chrono::duration<double>(now - previousTime).count();
+
+		const size_t completed = itsCompleted.exchange(0);
+		const size_t timed = std::max<size_t>(1, itsTimedCount.exchange(0));
+
+		const double throughput = static_cast<double>(completed) / elapsed;
+		const double cpuUsage = (cpuTime - previousCPUTime) / elapsed;
+
+		const size_t metadataTime = itsMetadataTime.exchange(0) / timed;
+		const size_t writeTime = itsWriteTime.exchange(0) / timed;
+		const size_t databaseTime = itsDatabaseTime.exchange(0) / timed;
+
+		previousTime = now;
+		previousCPUTime = cpuTime;
+
+		if (completed == 0)
+		{
+			continue;
+		}
+
+		// Reverse direction if the previous step made things worse
+
+		if (previousThroughput > 0 && throughput < previousThroughput * (1 - kTolerance))
+		{
+			direction = -direction;
+		}
+
+		const short active = itsActive;
+		short next = static_cast<short>(active + direction);
+
+		if (direction > 0 && cpuUsage >= 0.9 * cpuLimit)
+		{
+			// No room for more work on cpu
+			next = static_cast<short>(active - 1);
+			direction = -1;
+		}
+
+		next = std::max<short>(1, std::min(next, itsMaxWorkers));
+
+		if (next == active)
+		{
+			// At a bound: try the other direction next time
+			direction = -direction;
+		}
+
+		logr.Debug(fmt::format("{} workers: {:.1f} messages/s, cpu {:.1f}/{:.1f}, metadata={} write={} db={} ms",
+		                       active, throughput, cpuUsage, cpuLimit, metadataTime, writeTime, databaseTime));
+
+		if (next != active)
+		{
+			logr.Info(fmt::format(
+			    "Workers {} -> {}: {:.1f} messages/s (previous {:.1f}), cpu {:.1f}/{:.1f}, metadata={} write={} db={} ms",
+			    active, next, throughput, previousThroughput, cpuUsage, cpuLimit, metadataTime, writeTime,
+			    databaseTime));
+
+			{
+				std::lock_guard<std::mutex> lock(itsMutex);
+				itsActive = next;
+			}
+
+			itsWorkerCondition.notify_all();
+		}
+
+		previousThroughput = throughput;
+	}
+}
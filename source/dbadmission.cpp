@@ -0,0 +1,239 @@
+#include "dbadmission.h"
+#include "logger.h"
+#include "options.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <mutex>
+#include <random>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+extern grid_to_radon::Options options;
+
+using namespace grid_to_radon;
+
+// Smoothing factor of the latency average
+static const double kAlpha = 0.1;
+
+// Latency is considered elevated when average exceeds the baseline by this factor
+static const double kThreshold = 1.5;
+
+// Slot acquisition is retried with exponential backoff between these limits, ms
+static const int kMinBackoff = 1;
+static const int kMaxBackoff = 200;
+
+static std::mutex stateMutex;
+static double averageLatency = 0;  // ms
+static double baselineLatency = 0;
+static size_t samples = 0;
+static int slotLimit = 0;
+
+static size_t acquisitions = 0;
+static double totalWait = 0;  // ms
+static double maxWait = 0;
+
+static double Now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string SlotDirectory()
+{
+	const char* env = getenv("GRID_TO_RADON_DB_SLOT_DIR");
+	return (env) ? std::string(env) : std::string("/tmp/grid_to_radon_db_slots");
+}
+
+// Directory is shared by all users like /tmp: writable for all, with sticky
+// bit, regardless of umask of the process that creates it
+
+static void CreateSlotDirectory(const std::string& dir)
+{
+	namespace fs = std::filesystem;
+
+	if (fs::create_directories(dir))
+	{
+		std::error_code ec;
+		fs::permissions(dir, fs::perms::all | fs::perms::sticky_bit, ec);
+	}
+}
+
+static int SlotLimit()
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+
+	if (slotLimit == 0)
+	{
+		slotLimit = options.max_db_concurrency;
+	}
+
+	return slotLimit;
+}
+
+static void UpdateLatency(double latency)
+{
+	std::lock_guard<std::mutex> lock(stateMutex);
+
+	averageLatency = (samples == 0) ? latency : kAlpha * latency + (1 - kAlpha) * averageLatency;
+	samples++;
+
+	// Baseline follows the lowest average, but is slowly relaxed towards the
+	// current average so that a permanent change in load is eventually accepted
+
+	if (samples == 10 || (samples > 10 && averageLatency < baselineLatency))
+	{
+		baselineLatency = averageLatency;
+	}
+	else if (samples > 10)
+	{
+		baselineLatency += (averageLatency - baselineLatency) * 0.001;
+	}
+
+	if (samples < 10)
+	{
+		return;
+	}
+
+	const int maxSlots = options.max_db_concurrency;
+	int limit = maxSlots;
+
+	if (averageLatency > kThreshold * baselineLatency)
+	{
+		limit = std::max(1, static_cast<int>(std::lround(maxSlots * baselineLatency / averageLatency)));
+	}
+
+	if (limit != slotLimit)
+	{
+		himan::logger logr("dbadmission");
+		logr.Debug(fmt::format("Database latency {:.1f} ms (baseline {:.1f} ms), using {}/{} slots", averageLatency,
+		                       baselineLatency, limit, maxSlots));
+		slotLimit = limit;
+	}
+}
+
+// Slot files are only locked, never written, so read access is enough. A new
+// file is made writable for all, regardless of umask, so that processes of
+// other users can share the slots.
+
+static int OpenSlotFile(const std::string& fileName)
+{
+	int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd == -1 && errno == ENOENT)
+	{
+		fd = open(fileName.c_str(), O_RDONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+
+		if (fd != -1)
+		{
+			fchmod(fd, 0666);
+		}
+		else if (errno == EEXIST)
+		{
+			fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+		}
+	}
+
+	return fd;
+}
+
+dbadmission::Slot::Slot() : itsFd(-1), itsStart(0)
+{
+	if (options.max_db_concurrency <= 0)
+	{
+		return;
+	}
+
+	static std::once_flag dirCreated;
+	const std::string dir = SlotDirectory();
+
+	std::call_once(dirCreated, [&]() { CreateSlotDirectory(dir); });
+
+	thread_local std::minstd_rand random(static_cast<unsigned int>(getpid()) ^
+	                                     std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	const double start = Now();
+	int backoff = kMinBackoff;
+
+	// Slots are always tried from the first one, so that a reduced limit
+	// applies to processes that started with a higher one. Slot is waited for
+	// also when stop is requested, as the operation is run in any case.
+
+	while (true)
+	{
+		const int limit = SlotLimit();
+
+		for (int i = 0; i < limit && itsFd == -1; i++)
+		{
+			const int fd = OpenSlotFile(fmt::format("{}/slot.{}", dir, i));
+
+			if (fd == -1)
+			{
+				throw std::runtime_error(fmt::format("Unable to open database slot file in '{}'", dir));
+			}
+
+			if (flock(fd, LOCK_EX | LOCK_NB) == 0)
+			{
+				itsFd = fd;
+			}
+			else
+			{
+				close(fd);
+			}
+		}
+
+		if (itsFd != -1)
+		{
+			break;
+		}
+
+		// Jitter prevents processes from retrying in lockstep
+
+		const int sleepTime = backoff / 2 + static_cast<int>(random() % static_cast<unsigned int>(backoff / 2 + 1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(sleepTime));
+		backoff = std::min(kMaxBackoff, backoff * 2);
+	}
+
+	itsStart = Now();
+
+	const double wait = itsStart - start;
+
+	std::lock_guard<std::mutex> lock(stateMutex);
+	acquisitions++;
+	totalWait += wait;
+	maxWait = std::max(maxWait, wait);
+}
+
+dbadmission::Slot::~Slot()
+{
+	if (itsFd == -1)
+	{
+		return;
+	}
+
+	const double latency = Now() - itsStart;
+
+	flock(itsFd, LOCK_UN);
+	close(itsFd);
+
+	UpdateLatency(latency);
+}
+
+void dbadmission::Report()
+{
+	if (options.max_db_concurrency <= 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(stateMutex);
+
+	himan::logger logr("dbadmission");
+	logr.Info(fmt::format("Waited {:.0f} ms for database admission in {} operations (max {:.0f} ms), latency {:.1f} ms",
+	                      totalWait, acquisitions, maxWait, averageLatency));
+}
@@ -0,0 +1,184 @@
+#include "fieldstats.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using namespace grid_to_radon;
+
+namespace
+{
+struct accumulator
+{
+	double min = std::numeric_limits<double>::infinity();
+	double max = -std::numeric_limits<double>::infinity();
+	double sum = 0;
+	size_t valid = 0;
+};
+
+void Scalar(const double* values, size_t size, accumulator& acc)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		const double x = values[i];
+
+		if (std::isnan(x))
+		{
+			continue;
+		}
+
+		acc.min = std::min(acc.min, x);
+		acc.max = std::max(acc.max, x);
+		acc.sum += x;
+		acc.valid++;
+	}
+}
+
+typedef size_t (*kernel)(const double*, size_t, accumulator&);
+
+#if defined(__x86_64__)
+
+// Vector kernels handle full vectors, the remainder is left to the scalar
+// kernel. NaN lanes are masked out with an ordered comparison of the value
+// with itself.
+
+__attribute__((target("avx2"))) size_t AVX2(const double* values, size_t size, accumulator& acc)
+{
+	__m256d vmin = _mm256_set1_pd(acc.min);
+	__m256d vmax = _mm256_set1_pd(acc.max);
+	__m256d vsum = _mm256_setzero_pd();
+	size_t valid = 0;
+	size_t i = 0;
+
+	for (; i + 4 <= size; i += 4)
+	{
+		const __m256d x = _mm256_loadu_pd(values + i);
+		const __m256d ok = _mm256_cmp_pd(x, x, _CMP_ORD_Q);
+
+		vmin = _mm256_min_pd(vmin, _mm256_blendv_pd(vmin, x, ok));
+		vmax = _mm256_max_pd(vmax, _mm256_blendv_pd(vmax, x, ok));
+		vsum = _mm256_add_pd(vsum, _mm256_and_pd(x, ok));
+		valid += static_cast<size_t>(__builtin_popcount(static_cast<unsigned int>(_mm256_movemask_pd(ok))));
+	}
+
+	alignas(32) double lanes[3][4];
+	_mm256_store_pd(lanes[0], vmin);
+	_mm256_store_pd(lanes[1], vmax);
+	_mm256_store_pd(lanes[2], vsum);
+
+	for (int j = 0; j < 4; j++)
+	{
+		acc.min = std::min(acc.min, lanes[0][j]);
+		acc.max = std::max(acc.max, lanes[1][j]);
+		acc.sum += lanes[2][j];
+	}
+
+	acc.valid += valid;
+
+	return i;
+}
+
+__attribute__((target("avx512f"))) size_t AVX512(const double* values, size_t size, accumulator& acc)
+{
+	__m512d vmin = _mm512_set1_pd(acc.min);
+	__m512d vmax = _mm512_set1_pd(acc.max);
+	__m512d vsum = _mm512_setzero_pd();
+	size_t valid = 0;
+	size_t i = 0;
+
+	for (; i + 8 <= size; i += 8)
+	{
+		const __m512d x = _mm512_loadu_pd(values + i);
+		const __mmask8 ok = _mm512_cmp_pd_mask(x, x, _CMP_ORD_Q);
+
+		vmin = _mm512_mask_min_pd(vmin, ok, vmin, x);
+		vmax = _mm512_mask_max_pd(vmax, ok, vmax, x);
+		vsum = _mm512_mask_add_pd(vsum, ok, vsum, x);
+		valid += static_cast<size_t>(__builtin_popcount(ok));
+	}
+
+	alignas(64) double lanes[3][8];
+	_mm512_store_pd(lanes[0], vmin);
+	_mm512_store_pd(lanes[1], vmax);
+	_mm512_store_pd(lanes[2], vsum);
+
+	for (int j = 0; j < 8; j++)
+	{
+		acc.min = std::min(acc.min, lanes[0][j]);
+		acc.max = std::max(acc.max, lanes[1][j]);
+		acc.sum += lanes[2][j];
+	}
+
+	acc.valid += valid;
+
+	return i;
+}
+
+kernel SelectKernel()
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		return AVX512;
+	}
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return AVX2;
+	}
+
+	return nullptr;
+}
+
+#else
+
+// Other architectures use the scalar kernel only
+
+kernel SelectKernel()
+{
+	return nullptr;
+}
+
+#endif
+}  // namespace
+
+field_stats fieldstats::Compute(const double* values, size_t size)
+{
+	static const kernel vectorKernel = SelectKernel();
+
+	accumulator acc;
+	size_t done = 0;
+
+	if (vectorKernel)
+	{
+		done = vectorKernel(values, size, acc);
+	}
+
+	Scalar(values + done, size - done, acc);
+
+	field_stats stats;
+	stats.count = size;
+	stats.missing = size - acc.valid;
+
+	if (acc.valid > 0)
+	{
+		stats.min = acc.min;
+		stats.max = acc.max;
+		stats.mean = acc.sum / static_cast<double>(acc.valid);
+	}
+	else
+	{
+		stats.min = stats.max = stats.mean = std::numeric_limits<double>::quiet_NaN();
+	}
+
+	return stats;
+}
+
+field_stats fieldstats::Compute(const std::vector<double>& values)
+{
+	return Compute(values.data(), values.size());
+}
@@ -0,0 +1,150 @@
+#include "filefollower.h"
+#include "common.h"
+#include "logger.h"
+#include "options.h"
+#include <cerrno>
+#include <filesystem>
+#include <fmt/format.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern grid_to_radon::Options options;
+
+using namespace grid_to_radon;
+
+// Inotify events are not delivered for all file systems (for example nfs),
+// so file size is also checked at least this often
+static const int kPollIntervalMs = 1000;
+
+FileFollower::FileFollower(int fd, const std::string& theFileName)
+    : itsFd(fd),
+      itsFileName(theFileName),
+      itsInotifyFd(-1),
+      itsLastData(std::chrono::steady_clock::now()),
+      itsEnded(false)
+{
+	himan::logger logr("filefollower");
+
+	itsInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (itsInotifyFd != -1 && inotify_add_watch(itsInotifyFd, theFileName.c_str(), IN_MODIFY) == -1)
+	{
+		close(itsInotifyFd);
+		itsInotifyFd = -1;
+	}
+
+	if (itsInotifyFd == -1)
+	{
+		logr.Warning(fmt::format("inotify not available for '{}', polling file size", theFileName));
+	}
+}
+
+FileFollower::~FileFollower()
+{
+	if (itsInotifyFd != -1)
+	{
+		close(itsInotifyFd);
+	}
+}
+
+size_t FileFollower::Read(unsigned char* buffer, size_t length)
+{
+	size_t nread = 0;
+
+	while (nread < length)
+	{
+		const ssize_t ret = read(itsFd, buffer + nread, length - nread);
+
+		if (ret > 0)
+		{
+			nread += static_cast<size_t>(ret);
+			itsLastData = std::chrono::steady_clock::now();
+			continue;
+		}
+
+		if (ret == -1 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (ret == -1 || !Wait())
+		{
+			break;
+		}
+	}
+
+	return nread;
+}
+
+bool FileFollower::HasMoreData() const
+{
+	struct stat st;
+
+	return (fstat(itsFd, &st) == 0 && st.st_size > lseek(itsFd, 0, SEEK_CUR));
+}
+
+bool FileFollower::Wait()
+{
+	if (itsEnded)
+	{
+		return false;
+	}
+
+	himan::logger logr("filefollower");
+
+	while (!common::StopRequested())
+	{
+		if (HasMoreData())
+		{
+			return true;
+		}
+
+		// Sentinel is checked only after the size: data written before the
+		// sentinel was created is always read
+
+		if (!options.follow_sentinel.empty() && std::filesystem::exists(options.follow_sentinel))
+		{
+			if (HasMoreData())
+			{
+				return true;
+			}
+
+			logr.Info(fmt::format("Sentinel file '{}' found, end of '{}'", options.follow_sentinel, itsFileName));
+			itsEnded = true;
+			return false;
+		}
+
+		const auto idle = std::chrono::steady_clock::now() - itsLastData;
+
+		if (options.follow_idle_timeout > 0 && idle >= std::chrono::seconds(options.follow_idle_timeout))
+		{
+			logr.Info(fmt::format("File '{}' has not grown in {} seconds, ending", itsFileName,
+			                      options.follow_idle_timeout));
+			itsEnded = true;
+			return false;
+		}
+
+		if (itsInotifyFd == -1)
+		{
+			usleep(kPollIntervalMs * 1000);
+			continue;
+		}
+
+		pollfd pfd{itsInotifyFd, POLLIN, 0};
+
+		if (poll(&pfd, 1, kPollIntervalMs) > 0)
+		{
+			// Drain events, file size tells what is available
+
+			char events[4096];
+			while (read(itsInotifyFd, events, sizeof(events)) > 0)
+			{
+			}
+		}
+	}
+
+	itsEnded = true;
+	return false;
+}
@@ -3,6 +3,15 @@
 #include "options.h"
 #include "plugin_factory.h"
 #include "timer.h"
+#include <algorithm>
+#include <atomic>
+#include <cpl_conv.h>
+#include <fmt/ranges.h>
+#include <fstream>
+#include <gdal.h>
+#include <limits>
+#include <stdexcept>
+#include <thread>
 
 #define HIMAN_AUXILIARY_INCLUDE
 #include "geotiff.h"
@@ -11,7 +20,200 @@
 
 extern grid_to_radon::Options options;
 
-std::pair<bool, grid_to_radon::records> grid_to_radon::GeoTIFFLoader::Load(const std::string& theInfile_) const
+using grid_to_radon::tile_layout;
+
+static std::string GDALFileName(const std::string& theInfile)
+{
+	if (!options.s3)
+	{
+		return theInfile;
+	}
+
+	// Map libs3 environment to the configuration used by gdal /vsis3/
+
+	const char* host = getenv("S3_HOSTNAME");
+
+	if (host && !getenv("AWS_S3_ENDPOINT"))
+	{
+		CPLSetConfigOption("AWS_S3_ENDPOINT", host);
+	}
+
+	const char* accessKey = getenv("S3_ACCESS_KEY_ID");
+	const char* secretKey = getenv("S3_SECRET_ACCESS_KEY");
+
+	if (accessKey && secretKey && !getenv("AWS_ACCESS_KEY_ID"))
+	{
+		CPLSetConfigOption("AWS_ACCESS_KEY_ID", accessKey);
+		CPLSetConfigOption("AWS_SECRET_ACCESS_KEY", secretKey);
+	}
+
+	return "/vsis3/" + theInfile;
+}
+
+// Read tile offset tables of all bands, if file is a Cloud-Optimized GeoTIFF.
+// With COG the tables are in the header, so this does not read any image data.
+
+static std::vector<tile_layout> ReadTileLayout(const std::string& theInfile)
+{
+	himan::logger logr("geotiffloader");
+
+	GDALAllRegister();
+
+	GDALDatasetH ds = GDALOpenEx(GDALFileName(theInfile).c_str(), GDAL_OF_RASTER | GDAL_OF_READONLY, nullptr,
+	                             nullptr, nullptr);
+
+	std::vector<tile_layout> layouts;
+
+	if (!ds)
+	{
+		logr.Warning(fmt::format("Unable to open file '{}' for reading tile layout", theInfile));
+		return layouts;
+	}
+
+	const char* layout = GDALGetMetadataItem(ds, "LAYOUT", "IMAGE_STRUCTURE");
+
+	if (!layout || std::string(layout) != "COG")
+	{
+		logr.Debug("File is not a Cloud-Optimized GeoTIFF");
+		GDALClose(ds);
+		return layouts;
+	}
+
+	const int width = GDALGetRasterXSize(ds);
+	const int height = GDALGetRasterYSize(ds);
+
+	for (int bandNo = 1; bandNo <= GDALGetRasterCount(ds); bandNo++)
+	{
+		GDALRasterBandH band = GDALGetRasterBand(ds, bandNo);
+
+		tile_layout tl;
+		tl.band = bandNo;
+
+		GDALGetBlockSize(band, &tl.tile_width, &tl.tile_height);
+
+		tl.tiles_x = (width + tl.tile_width - 1) / tl.tile_width;
+		tl.tiles_y = (height + tl.tile_height - 1) / tl.tile_height;
+
+		for (int y = 0; y < tl.tiles_y; y++)
+		{
+			for (int x = 0; x < tl.tiles_x; x++)
+			{
+				const char* offset =
+				    GDALGetMetadataItem(band, fmt::format("BLOCK_OFFSET_{}_{}", x, y).c_str(), "TIFF");
+				const char* size = GDALGetMetadataItem(band, fmt::format("BLOCK_SIZE_{}_{}", x, y).c_str(), "TIFF");
+
+				tl.offsets.push_back(offset ? std::stoul(offset) : 0UL);
+				tl.byte_counts.push_back(size ? std::stoul(size) : 0UL);
+			}
+		}
+
+		layouts.push_back(tl);
+	}
+
+	GDALClose(ds);
+
+	return layouts;
+}
+
+// Byte range covering all tiles of a band
+
+static std::pair<unsigned long, unsigned long> ByteRange(const tile_layout& tl)
+{
+	unsigned long first = std::numeric_limits<unsigned long>::max(), last = 0;
+
+	for (size_t i = 0; i < tl.offsets.size(); i++)
+	{
+		if (tl.byte_counts[i] == 0)
+		{
+			continue;
+		}
+
+		first = std::min(first, tl.offsets[i]);
+		last = std::max(last, tl.offsets[i] + tl.byte_counts[i]);
+	}
+
+	if (last == 0)
+	{
+		return std::make_pair(0UL, 0UL);
+	}
+
+	return std::make_pair(first, last - first);
+}
+
+// String as json string literal
+
+static std::string JSONString(const std::string& str)
+{
+	std::string ret = "\"";
+
+	for (const char c : str)
+	{
+		switch (c)
+		{
+			case '"':
+				ret += "\\\"";
+				break;
+			case '\\':
+				ret += "\\\\";
+				break;
+			case '\n':
+				ret += "\\n";
+				break;
+			case '\t':
+				ret += "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+				{
+					ret += fmt::format("\\u{:04x}", static_cast<int>(c));
+				}
+				else
+				{
+					ret += c;
+				}
+		}
+	}
+
+	return ret + "\"";
+}
+
+grid_to_radon::TileIndexWriter::TileIndexWriter(const std::string& theFileName) : itsFileName(theFileName)
+{
+	itsStream.open(itsFileName, std::ios::trunc);
+
+	if (!itsStream)
+	{
+		throw std::runtime_error(fmt::format("Unable to open tile index file '{}'", itsFileName));
+	}
+}
+
+// Byte range covering all tiles of the band is written with the tile tables,
+// band registration in radon refers to the whole file
+
+void grid_to_radon::TileIndexWriter::Add(const std::string& fileName, const std::vector<tile_layout>& layouts)
+{
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	for (const auto& tl : layouts)
+	{
+		const auto range = ByteRange(tl);
+
+		itsStream << fmt::format(
+		    "{{ \"file_name\" : {}, \"band\" : {}, \"offset\" : {}, \"length\" : {}, \"tile_width\" : {}, "
+		    "\"tile_height\" : {}, \"tiles_x\" : {}, \"tiles_y\" : {}, \"offsets\" : [{}], "
+		    "\"byte_counts\" : [{}] }}\n",
+		    JSONString(fileName), tl.band, range.first, range.second, tl.tile_width, tl.tile_height, tl.tiles_x,
+		    tl.tiles_y, fmt::join(tl.offsets, ","), fmt::join(tl.byte_counts, ","));
+	}
+
+	itsStream.flush();
+
+	himan::logger logr("geotiffloader");
+	logr.Info(fmt::format("Wrote tile index of {} bands to '{}'", layouts.size(), itsFileName));
+}
+
+bool grid_to_radon::GeoTIFFLoader::Load(const std::string& theInfile_, RecordSink& sink,
+                                        TileIndexWriter* tileIndex) const
 {
 	auto geotiffpl = GET_PLUGIN(geotiff);
 
@@ -63,45 +265,108 @@ std::pair<bool, grid_to_radon::records> grid_to_radon::GeoTIFFLoader::Load(const
 	if (infos.empty())
 	{
 		logr.Warning("No valid data read from file");
-		return std::make_pair(false, grid_to_radon::records{});
+		return false;
 	}
 
 	logr.Info("Read metadata in " + std::to_string(t.GetTime()) + " ms");
 
-	auto radon = GET_PLUGIN(radon);
+	if (tileIndex)
+	{
+		t.Start();
+		const auto layouts = ReadTileLayout(theInfile);
+		t.Stop();
 
-	int success = 0, failed = 0;
-	grid_to_radon::records recs;
+		if (!layouts.empty())
+		{
+			logr.Info(fmt::format("Read tile layout of {} bands in {} ms", layouts.size(), t.GetTime()));
+			tileIndex->Add(finfo.file_location, layouts);
+		}
+	}
 
-	int bandNo = 1;
-	for (auto& info : infos)
+	// Bands are registered by options.threadcount workers. Each worker claims
+	// a run of consecutive bands at a time, to keep contention on the shared
+	// counter low, and saves each band with its own radon connection. Every
+	// band is still a separate statement: the plugin falls back to an update
+	// when the insert fails, which would abort a shared transaction. Results
+	// are stored by band index, so that records are passed on in band order
+	// regardless of the thread timing.
+
+	const size_t bandCount = infos.size();
+	const size_t claimSize = 16;
+
+	std::vector<std::pair<bool, grid_to_radon::record>> results(bandCount);
+	std::atomic<size_t> nextBand(0);
+
+	auto Register = [&](short threadId)
 	{
-		t.Start();
-		const std::string theFileName = grid_to_radon::common::MakeFileName(config, info, theInfile);
-		finfo.message_no = bandNo;
+		himan::logger wlogr("geotiffloader#" + std::to_string(threadId));
+		auto radon = GET_PLUGIN(radon);
+
+		size_t first;
+
+		while (!grid_to_radon::common::StopRequested() && (first = nextBand.fetch_add(claimSize)) < bandCount)
+		{
+			const size_t last = std::min(first + claimSize, bandCount);
+
+			for (size_t i = first; i < last; i++)
+			{
+				himan::timer bt(true);
+
+				auto& info = infos[i];
+				const int bandNo = static_cast<int>(i) + 1;
+
+				himan::file_information bfinfo = finfo;
+				bfinfo.message_no = bandNo;
+
+				results[i] = grid_to_radon::common::SaveToDatabase(config, info, radon, bfinfo);
+
+				bt.Stop();
+
+				wlogr.Info(fmt::format("Band {} {} dbtime={} ms", bandNo,
+				                       grid_to_radon::common::FormatInfoToString(info), bt.GetTime()));
+			}
+		}
+	};
+
+	const short threadCount =
+	    static_cast<short>(std::max<size_t>(1, std::min<size_t>(options.threadcount, bandCount)));
+
+	t.Start();
 
-		const auto ret = grid_to_radon::common::SaveToDatabase(config, info, radon, finfo);
+	std::vector<std::thread> threadgroup;
 
+	for (short i = 0; i < threadCount; i++)
+	{
+		threadgroup.push_back(std::thread(Register, i));
+	}
+
+	for (auto& th : threadgroup)
+	{
+		th.join();
+	}
+
+	t.Stop();
+
+	int success = 0, failed = 0;
+
+	for (const auto& ret : results)
+	{
 		if (ret.first)
 		{
 			success++;
-			recs.push_back(ret.second);
+			sink.Add(ret.second);
 		}
 		else
 		{
 			failed++;
 		}
-
-		t.Stop();
-
-		auto logmsg = fmt::format("Band {} {} dbtime={} ms", bandNo++, grid_to_radon::common::FormatInfoToString(info),
-		                          t.GetTime());
-		logr.Info(logmsg);
 	}
 
+	logr.Debug(fmt::format("Registered {} bands with {} threads in {} ms", bandCount, threadCount, t.GetTime()));
+
 	logr.Info(fmt::format("Success with {} fields, failed with {} fields", success, failed));
 
 	const bool retval = common::CheckForFailure(failed, 0, success);
 
-	return std::make_pair(retval, recs);
+	return retval;
 }
@@ -0,0 +1,123 @@
+#include "gribfilter.h"
+#include "NFmiGribMessage.h"
+#include <boost/algorithm/string.hpp>
+#include <fmt/format.h>
+#include <stdexcept>
+
+using namespace grid_to_radon;
+
+static long ParseValue(const std::string& str, const std::string& clause)
+{
+	size_t pos;
+	long value;
+
+	try
+	{
+		value = std::stol(str, &pos);
+	}
+	catch (const std::exception&)
+	{
+		pos = 0;
+	}
+
+	if (str.empty() || pos != str.size())
+	{
+		throw std::invalid_argument(fmt::format("Invalid value '{}' in filter clause '{}'", str, clause));
+	}
+
+	return value;
+}
+
+GribFilter::GribFilter(const std::string& expression)
+{
+	std::vector<std::string> clauses;
+	boost::split(clauses, expression, boost::is_any_of(","));
+
+	for (auto str : clauses)
+	{
+		boost::trim(str);
+
+		if (str.empty())
+		{
+			continue;
+		}
+
+		clause c;
+
+		auto pos = str.find('=');
+
+		if (pos == std::string::npos || pos == 0)
+		{
+			throw std::invalid_argument(fmt::format("Invalid filter clause '{}'", str));
+		}
+
+		c.negate = (str[pos - 1] == '!');
+		c.key = boost::trim_copy(str.substr(0, c.negate ? pos - 1 : pos));
+
+		if (c.key.empty())
+		{
+			throw std::invalid_argument(fmt::format("Missing key in filter clause '{}'", str));
+		}
+
+		std::vector<std::string> values;
+		boost::split(values, str.substr(pos + 1), boost::is_any_of("/"));
+
+		for (auto value : values)
+		{
+			boost::trim(value);
+
+			const auto range = value.find("..");
+
+			if (range == std::string::npos)
+			{
+				const long v = ParseValue(value, str);
+				c.ranges.emplace_back(v, v);
+			}
+			else
+			{
+				const long first = ParseValue(value.substr(0, range), str);
+				const long last = ParseValue(value.substr(range + 2), str);
+
+				if (first > last)
+				{
+					throw std::invalid_argument(fmt::format("Invalid range '{}' in filter clause '{}'", value, str));
+				}
+
+				c.ranges.emplace_back(first, last);
+			}
+		}
+
+		itsClauses.push_back(c);
+	}
+}
+
+bool GribFilter::Empty() const
+{
+	return itsClauses.empty();
+}
+
+bool GribFilter::Matches(NFmiGribMessage& message) const
+{
+	for (const auto& c : itsClauses)
+	{
+		const long value = message.GetLongKey(c.key);
+
+		bool found = false;
+
+		for (const auto& range : c.ranges)
+		{
+			if (value >= range.first && value <= range.second)
+			{
+				found = true;
+				break;
+			}
+		}
+
+		if (found == c.negate)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,213 @@
+#include "gribframer.h"
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+using namespace grid_to_radon;
+
+bool gribframer::IsMessageStart(const unsigned char* data, size_t size)
+{
+	return (size >= 4 && data[0] == 'G' && data[1] == 'R' && data[2] == 'I' && data[3] == 'B');
+}
+
+size_t gribframer::MessageLength(const unsigned char* header, size_t size)
+{
+	if (size < kHeaderSize || !IsMessageStart(header, size))
+	{
+		return 0;
+	}
+
+	const unsigned char edition = header[7];
+
+	if (edition == 1)
+	{
+		// octets 5-7: total length, 24 bits
+
+		const size_t length = (static_cast<size_t>(header[4]) << 16) | (static_cast<size_t>(header[5]) << 8) |
+		                      static_cast<size_t>(header[6]);
+
+		if (length & 0x800000 || length < kHeaderSize + 4)
+		{
+			return 0;
+		}
+
+		return length;
+	}
+	else if (edition == 2)
+	{
+		// octets 9-16: total length, 64 bits
+
+		size_t length = 0;
+
+		for (size_t i = 8; i < 16; i++)
+		{
+			length = (length << 8) | static_cast<size_t>(header[i]);
+		}
+
+		return (length < kHeaderSize + 4) ? 0 : length;
+	}
+
+	return 0;
+}
+
+static size_t ReadNumber(const unsigned char* data, size_t octets)
+{
+	size_t value = 0;
+
+	for (size_t i = 0; i < octets; i++)
+	{
+		value = (value << 8) | static_cast<size_t>(data[i]);
+	}
+
+	return value;
+}
+
+size_t gribframer::HeaderSectionsLength(const unsigned char* message, size_t size)
+{
+	if (MessageLength(message, size) == 0)
+	{
+		return 0;
+	}
+
+	if (message[7] == 1)
+	{
+		// Section 1 starts at octet 9; its octet 8 tells if section 2 (grid
+		// description) and section 3 (bitmap) are included
+
+		const size_t pdsOffset = 8;
+
+		if (size < pdsOffset + 8)
+		{
+			return 0;
+		}
+
+		size_t length = pdsOffset + ReadNumber(message + pdsOffset, 3);
+
+		if (message[pdsOffset + 7] & 0x80)
+		{
+			if (size < length + 3)
+			{
+				return 0;
+			}
+
+			length += ReadNumber(message + length, 3);
+		}
+
+		return (length <= size) ? length : 0;
+	}
+
+	// Each section starts with its length (4 octets) and number (1 octet)
+
+	size_t offset = kHeaderSize;
+
+	while (offset + 5 <= size)
+	{
+		const size_t length = ReadNumber(message + offset, 4);
+		const unsigned char number = message[offset + 4];
+
+		if (number == 6 || number == 7)
+		{
+			return offset;
+		}
+
+		if (memcmp(message + offset, "7777", 4) == 0 || length < 5)
+		{
+			return 0;
+		}
+
+		offset += length;
+	}
+
+	return 0;
+}
+
+bool gribframer::IsMessageComplete(const unsigned char* message, size_t length)
+{
+	return (length >= kHeaderSize + 4 && message[length - 4] == '7' && message[length - 3] == '7' &&
+	        message[length - 2] == '7' && message[length - 1] == '7');
+}
+
+static bool ReadAt(int fd, unsigned char* buffer, size_t length, size_t offset)
+{
+	size_t nread = 0;
+
+	while (nread < length)
+	{
+		const ssize_t ret = pread(fd, buffer + nread, length - nread, static_cast<off_t>(offset + nread));
+
+		if (ret <= 0)
+		{
+			return false;
+		}
+
+		nread += static_cast<size_t>(ret);
+	}
+
+	return true;
+}
+
+// Returns offset of next GRIB marker at or after offset, or fileSize if none is found
+
+static size_t FindMarker(int fd, size_t offset, size_t fileSize)
+{
+	const size_t chunkSize = 65536;
+	std::vector<unsigned char> buffer(chunkSize);
+
+	while (offset + 4 <= fileSize)
+	{
+		const size_t length = std::min(chunkSize, fileSize - offset);
+
+		if (!ReadAt(fd, buffer.data(), length, offset))
+		{
+			break;
+		}
+
+		for (size_t i = 0; i + 4 <= length; i++)
+		{
+			if (memcmp(buffer.data() + i, "GRIB", 4) == 0)
+			{
+				return offset + i;
+			}
+		}
+
+		// Marker may span two chunks
+
+		offset += length - 3;
+	}
+
+	return fileSize;
+}
+
+std::vector<gribframer::message_position> gribframer::Scan(int fd, size_t fileSize)
+{
+	std::vector<message_position> positions;
+
+	unsigned char header[kHeaderSize];
+	unsigned char trailer[4];
+	size_t offset = 0;
+
+	while (offset + kHeaderSize <= fileSize)
+	{
+		if (ReadAt(fd, header, kHeaderSize, offset))
+		{
+			const size_t length = MessageLength(header, kHeaderSize);
+
+			if (length > 0 && offset + length <= fileSize && ReadAt(fd, trailer, 4, offset + length - 4) &&
+			    memcmp(trailer, "7777", 4) == 0)
+			{
+				positions.push_back(message_position{static_cast<unsigned int>(positions.size()), offset, length});
+				offset += length;
+				continue;
+			}
+
+			if (IsMessageStart(header, kHeaderSize))
+			{
+				positions.push_back(message_position{static_cast<unsigned int>(positions.size()), offset, 0});
+			}
+		}
+
+		offset = FindMarker(fd, offset + 1, fileSize);
+	}
+
+	return positions;
+}
@@ -1,13 +1,27 @@
 #include "gribloader.h"
 #include "common.h"
+#include "fieldstats.h"
+#include "filefollower.h"
+#include "hybridlevelheight.h"
 #include "plugin_factory.h"
 #include "timer.h"
 #include "util.h"
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <eccodes.h>
+#include <fcntl.h>
+#include <filesystem>
 #include <fmt/ranges.h>
 #include <iomanip>
+#include <limits>
+#include <numeric>
 #include <sstream>
 #include <stdlib.h>
 #include <thread>
+#include <unistd.h>
 
 #define HIMAN_AUXILIARY_INCLUDE
 #include "grib.h"
@@ -19,44 +33,189 @@ extern grid_to_radon::Options options;
 using namespace std;
 
 bool grib1CacheInitialized = false, grib2CacheInitialized = false;
-std::mutex recordUpdateMutex;
 
-grid_to_radon::GribLoader::GribLoader() : g_success(0), g_skipped(0), g_failed(0)
+grid_to_radon::GribLoader::GribLoader()
+    : g_success(0),
+      g_skipped(0),
+      g_failed(0),
+      g_unchanged(0),
+      g_resumed(0),
+      g_repacked(0),
+      g_repackInputBytes(0),
+      g_repackOutputBytes(0),
+      g_repackTime(0),
+      itsSink(nullptr),
+      itsSkipUnchanged(options.skip_unchanged),
+      itsController(options.adaptive_threads),
+      itsHybridLevelHeight(nullptr),
+      itsFilter(options.filter)
 {
 }
 
-set<string> CheckForMultiTableGribs(const grid_to_radon::records& recs)
+static bool HashTableExists()
 {
-	set<string> tables;
-	for_each(recs.begin(), recs.end(), [&](const grid_to_radon::record& rec) { tables.insert(rec.table_name); });
+	auto r = GET_PLUGIN(radon);
 
-	return tables;
+	r->RadonDB().Query("SELECT to_regclass('grid_to_radon_hash') IS NOT NULL");
+
+	const auto row = r->RadonDB().FetchRow();
+
+	return (row.empty() == false && row[0] == "t");
 }
 
-pair<bool, grid_to_radon::records> grid_to_radon::GribLoader::Load(const string& theInfile)
+static size_t ReadFully(int fd, unsigned char* buffer, size_t length)
+{
+	size_t nread = 0;
+
+	while (nread < length)
+	{
+		const ssize_t ret = read(fd, buffer + nread, length - nread);
+
+		if (ret == -1 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (ret <= 0)
+		{
+			break;
+		}
+
+		nread += static_cast<size_t>(ret);
+	}
+
+	return nread;
+}
+
+bool grid_to_radon::GribLoader::Load(const string& theInfile, RecordSink& sink, HybridLevelHeight* hybridLevelHeight)
 {
 	itsInputFileName = theInfile;
-	itsReader.Open(theInfile);
+	itsSink = &sink;
 
-	vector<std::thread> threadgroup;
+	himan::logger logr("gribloader");
 
-	for (short i = 0; i < options.threadcount; i++)
+	if (!options.consolidated_output_dir.empty())
 	{
-		threadgroup.push_back(std::thread(&GribLoader::Run, this, i));
+		const std::string name = (theInfile == "-") ? "stdin" : std::filesystem::path(theInfile).filename().string();
+		static std::atomic<unsigned int> runCounter(0);
+
+		// Counter separates loads of the same file name within one second in this process
+		itsRunId = fmt::format("{}_{}_{}_{}", name, std::time(nullptr), getpid(), runCounter++);
 	}
 
-	for (auto& t : threadgroup)
+	if (itsSkipUnchanged)
 	{
-		t.join();
+		if (!HashTableExists())
+		{
+			logr.Warning("Table grid_to_radon_hash not found, loading all fields");
+			itsSkipUnchanged = false;
+		}
 	}
 
-	himan::logger logr("gribloader");
-	logr.Info(fmt::format("Success with {} fields, failed with {} fields, skipped {} fields",
-	                      static_cast<int>(g_success), static_cast<int>(g_failed), static_cast<int>(g_skipped)));
+	itsCheckpoint = std::make_unique<Checkpoint>(theInfile);
+
+	if (options.incremental_ss_state && options.ss_state_update)
+	{
+		if (common::Sharded())
+		{
+			logr.Warning("Incremental ss_state update is not possible with shards");
+		}
+		else
+		{
+			itsPublisher = std::make_unique<SSStatePublisher>();
+			itsPublisher->Start();
+		}
+	}
+
+	if (hybridLevelHeight)
+	{
+		if (common::Sharded())
+		{
+			logr.Warning("Hybrid level heights can not be calculated from a shard");
+		}
+		else if (itsCheckpoint->ResumedCount() > 0)
+		{
+			// Fields completed by the earlier run are not read again, so
+			// statistics of the run would be based on part of the fields
+
+			hybridLevelHeight->Disable(fmt::format("load of '{}' was resumed from checkpoint", theInfile));
+		}
+		else
+		{
+			itsHybridLevelHeight = hybridLevelHeight;
+		}
+	}
+
+	if (theInfile == "-")
+	{
+		if (!options.priority.empty())
+		{
+			logr.Warning("Priority order is not possible with stdin, loading in stream order");
+		}
+
+		LoadStream(
+		    [&](BoundedQueue<stream_message>& queue)
+		    {
+			    ReadStream([](unsigned char* buffer, size_t length) { return ReadFully(STDIN_FILENO, buffer, length); },
+			               queue);
+		    });
+	}
+	else if (options.follow)
+	{
+		LoadFollow(theInfile);
+	}
+	else if (common::Sharded() || !options.priority.empty() || itsSkipUnchanged)
+	{
+		// Indexed load keeps the undecoded message in memory for content hashing
+
+		LoadIndexed(theInfile);
+	}
+	else
+	{
+		LoadThreaded(theInfile);
+	}
+
+	std::string summary = fmt::format("Success with {} fields, failed with {} fields, skipped {} fields",
+	                                  static_cast<int>(g_success), static_cast<int>(g_failed),
+	                                  static_cast<int>(g_skipped));
+
+	if (itsSkipUnchanged)
+	{
+		summary += fmt::format(", unchanged {} fields", static_cast<int>(g_unchanged));
+	}
+
+	if (itsCheckpoint->ResumedCount() > 0)
+	{
+		summary += fmt::format(", resumed {} fields", static_cast<int>(g_resumed));
+	}
+
+	logr.Info(summary);
+
+	if (g_repacked > 0)
+	{
+		logr.Info(fmt::format(
+		    "Repacked {} messages to ccsds: {:.1f}MB -> {:.1f}MB (ratio {:.2f}), cpu time {} ms ({} us/message)",
+		    static_cast<int>(g_repacked), static_cast<double>(g_repackInputBytes) / 1024.0 / 1024.0,
+		    static_cast<double>(g_repackOutputBytes) / 1024.0 / 1024.0,
+		    static_cast<double>(g_repackInputBytes) / static_cast<double>(g_repackOutputBytes), g_repackTime / 1000,
+		    g_repackTime / static_cast<size_t>(g_repacked)));
+	}
+
+	if (itsPublisher)
+	{
+		itsPublisher->Stop();
+	}
+
+	if (common::StopRequested())
+	{
+		itsCheckpoint->Flush();
+		logr.Warning(fmt::format("Loading of file '{}' interrupted", theInfile));
+		return false;
+	}
 
 	if (options.in_place_insert)
 	{
-		const auto tables = CheckForMultiTableGribs(itsRecords);
+		const auto tables = itsCollected.Tables();
 
 		if (options.allow_multi_table_gribs == false && tables.size() > 1)
 		{
@@ -65,14 +224,45 @@ pair<bool, grid_to_radon::records> grid_to_radon::GribLoader::Load(const string&
 		}
 	}
 
-	const bool retval = common::CheckForFailure(g_skipped, g_failed, g_success);
+	// Unchanged and resumed fields are already in radon, so they don't count as a failure
+	const bool retval = common::CheckForFailure(g_failed, g_skipped, g_success + g_unchanged + g_resumed);
 
 	if (retval)
 	{
-		grid_to_radon::common::UpdateSSState(itsRecords);
+		if (common::Sharded())
+		{
+			logr.Info("ss_state update is left to the merge step of shards");
+		}
+		else if (itsPublisher)
+		{
+			// Publish steps that were not complete yet
+
+			for (const auto& key : itsCheckpoint->ResumedKeys())
+			{
+				itsPublisher->Add(key);
+			}
+
+			itsPublisher->Flush();
+			logr.Info(fmt::format("Published {} ss_state rows during load", itsPublisher->PublishedCount()));
+		}
+		else
+		{
+			for (const auto& key : itsCheckpoint->ResumedKeys())
+			{
+				itsCollected.Add(key);
+			}
+
+			grid_to_radon::common::UpdateSSState(itsCollected.Keys());
+		}
+
+		itsCheckpoint->Remove();
+	}
+	else
+	{
+		itsCheckpoint->Flush();
 	}
 
-	return make_pair(retval, itsRecords);
+	return retval;
 }
 
 void grid_to_radon::GribLoader::Run(short threadId)
@@ -83,11 +273,17 @@ void grid_to_radon::GribLoader::Run(short threadId)
 	NFmiGribMessage myMessage;
 	unsigned int messageNo;
 
+	itsController.WaitActive(threadId);
+
 	while (DistributeMessages(myMessage, messageNo))
 	{
-		Process(myMessage, threadId, messageNo);
+		Process(myMessage, threadId, messageNo, itsReader.Offset(messageNo));
+		itsController.Completed();
+		itsController.WaitActive(threadId);
 	}
 
+	itsController.Finish();
+
 	logr.Info("Stopped");
 }
 
@@ -95,9 +291,16 @@ bool grid_to_radon::GribLoader::DistributeMessages(NFmiGribMessage& newMessage,
 {
 	lock_guard<mutex> lock(distMutex);
 
-	if (itsReader.NextMessage())
+	while (!common::StopRequested() && itsReader.NextMessage())
 	{
 		messageNo = static_cast<unsigned int>(itsReader.CurrentMessageIndex());
+
+		if (itsCheckpoint->Enabled() && itsCheckpoint->IsDone(CheckpointItem(messageNo, itsReader.Offset(messageNo))))
+		{
+			g_resumed++;
+			continue;
+		}
+
 		newMessage.DeleteHandle();
 		newMessage = NFmiGribMessage(itsReader.Message());
 		return true;
@@ -106,8 +309,499 @@ bool grid_to_radon::GribLoader::DistributeMessages(NFmiGribMessage& newMessage,
 	return false;
 }
 
+// Message is identified by its number and offset, so that a checkpoint
+// is not applied to a different file
+
+std::string grid_to_radon::GribLoader::CheckpointItem(unsigned int messageNo, unsigned long offset)
+{
+	return fmt::format("{}@{}", messageNo, offset);
+}
+
+short grid_to_radon::GribLoader::WorkerCount() const
+{
+	return (itsController.Enabled()) ? itsController.MaxWorkers() : options.threadcount;
+}
+
+// Streaming mode for pipes: main thread frames messages from the stream using
+// the length in section 0 and worker threads decode and load them. The queue
+// is bounded so that memory usage stays constant regardless of input size.
+
+void grid_to_radon::GribLoader::LoadStream(const std::function<void(BoundedQueue<stream_message>&)>& reader)
+{
+	BoundedQueue<stream_message> queue(4 * static_cast<size_t>(WorkerCount()));
+
+	vector<std::thread> threadgroup;
+
+	for (short i = 0; i < WorkerCount(); i++)
+	{
+		threadgroup.push_back(std::thread(&GribLoader::RunStream, this, i, std::ref(queue)));
+	}
+
+	itsController.Start();
+
+	reader(queue);
+
+	queue.Close();
+
+	for (auto& t : threadgroup)
+	{
+		t.join();
+	}
+
+	itsController.Stop();
+}
+
+void grid_to_radon::GribLoader::ReadStream(const std::function<size_t(unsigned char*, size_t)>& readBytes,
+                                           BoundedQueue<stream_message>& queue)
+{
+	himan::logger logr("gribloader");
+
+	unsigned char header[gribframer::kHeaderSize];
+	size_t have = 0, offset = 0, skippedBytes = 0;
+	unsigned int messageNo = 0;
+
+	// Bytes skipped while resynchronizing are reported once per contiguous
+	// run. A run that starts with a rejected message is already counted as
+	// failed with that message.
+
+	size_t skipStart = 0, skipLength = 0;
+	bool skipCounted = false;
+
+	auto EndSkip = [&]()
+	{
+		if (skipLength == 0)
+		{
+			return;
+		}
+
+		logr.Warning(fmt::format("Skipped {} bytes of non-grib data at offset {}", skipLength, skipStart));
+
+		if (!skipCounted)
+		{
+			g_failed++;
+		}
+
+		skippedBytes += skipLength;
+		skipLength = 0;
+		skipCounted = false;
+	};
+
+	while (!common::StopRequested() &&
+	       (options.follow_message_count == 0 || messageNo < options.follow_message_count))
+	{
+		have += readBytes(header + have, gribframer::kHeaderSize - have);
+
+		if (have < gribframer::kHeaderSize)
+		{
+			if (have > 0)
+			{
+				logr.Warning(fmt::format("Ignoring {} trailing bytes at offset {}", have, offset));
+			}
+			break;
+		}
+
+		size_t length = 0;
+
+		if (gribframer::IsMessageStart(header, have))
+		{
+			length = gribframer::MessageLength(header, have);
+
+			if (length == 0)
+			{
+				// Message takes a number, as with indexed read
+				EndSkip();
+				logr.Error(fmt::format("Message {} at offset {} has unsupported or invalid length (eg. GRIB1 over 8MB)",
+				                       messageNo, offset));
+				g_failed++;
+				messageNo++;
+				skipCounted = true;
+			}
+		}
+
+		// Not at the start of a valid message: resynchronize byte by byte
+
+		if (length == 0)
+		{
+			if (skipLength == 0)
+			{
+				skipStart = offset;
+			}
+
+			memmove(header, header + 1, have - 1);
+			have--;
+			offset++;
+			skipLength++;
+			continue;
+		}
+
+		EndSkip();
+
+		stream_message msg;
+		msg.message_no = messageNo;
+		msg.offset = offset;
+		msg.data.resize(length);
+
+		memcpy(msg.data.data(), header, gribframer::kHeaderSize);
+
+		const size_t remaining = length - gribframer::kHeaderSize;
+
+		if (readBytes(msg.data.data() + gribframer::kHeaderSize, remaining) != remaining)
+		{
+			logr.Error(fmt::format("Message {} at offset {} is truncated", messageNo, offset));
+			g_failed++;
+			offset += length;
+			break;
+		}
+
+		if (gribframer::IsMessageComplete(msg.data.data(), length))
+		{
+			queue.Push(std::move(msg));
+		}
+		else
+		{
+			logr.Error(fmt::format("Message {} at offset {} does not end with 7777", messageNo, offset));
+			g_failed++;
+		}
+
+		offset += length;
+		messageNo++;
+		have = 0;
+	}
+
+	EndSkip();
+
+	if (skippedBytes > 0)
+	{
+		logr.Warning(fmt::format("Skipped {} bytes of non-grib data in total", skippedBytes));
+	}
+
+	logr.Info(fmt::format("Read {} messages ({:.1f}MB) from stream", messageNo,
+	                      static_cast<double>(offset) / 1024.0 / 1024.0));
+}
+
+// Follow mode: file is read as a stream while it is being written. Messages
+// are loaded as soon as they are complete.
+
+void grid_to_radon::GribLoader::LoadFollow(const std::string& theInfile)
+{
+	const int fd = open(theInfile.c_str(), O_RDONLY);
+
+	if (fd == -1)
+	{
+		throw std::runtime_error(fmt::format("Unable to open file '{}'", theInfile));
+	}
+
+	FileFollower follower(fd, theInfile);
+
+	LoadStream(
+	    [&](BoundedQueue<stream_message>& queue)
+	    { ReadStream([&](unsigned char* buffer, size_t length) { return follower.Read(buffer, length); }, queue); });
+
+	close(fd);
+}
+
+void grid_to_radon::GribLoader::RunStream(short threadId, BoundedQueue<stream_message>& queue)
+{
+	himan::logger logr("gribloader#" + to_string(threadId));
+	logr.Info("Started");
+
+	stream_message msg;
+
+	itsController.WaitActive(threadId);
+
+	for (; queue.Pop(msg); itsController.WaitActive(threadId))
+	{
+		NFmiGrib reader;
+		std::unique_ptr<FILE> fp(fmemopen(msg.data.data(), msg.data.size(), "r"));
+
+		if (!fp || !reader.Open(std::move(fp)) || !reader.NextMessage())
+		{
+			logr.Error(fmt::format("Failed to decode message {}", msg.message_no));
+			g_failed++;
+			continue;
+		}
+
+		Process(reader.Message(), threadId, msg.message_no, msg.offset, msg.data);
+		itsController.Completed();
+	}
+
+	itsController.Finish();
+
+	logr.Info("Stopped");
+}
+
+// Shard and priority mode: messages are located by scanning the headers of the
+// whole file, which gives the same message numbers and offsets as reading the
+// file from the start. With a shard only messages starting inside its byte
+// range are read and loaded.
+
+// Messages are read with NFmiGrib and distributed to worker threads
+
+void grid_to_radon::GribLoader::LoadThreaded(const std::string& theInfile)
+{
+	itsReader.Open(theInfile);
+
+	vector<std::thread> threadgroup;
+
+	for (short i = 0; i < WorkerCount(); i++)
+	{
+		threadgroup.push_back(std::thread(&GribLoader::Run, this, i));
+	}
+
+	itsController.Start();
+
+	for (auto& t : threadgroup)
+	{
+		t.join();
+	}
+
+	itsController.Stop();
+}
+
+void grid_to_radon::GribLoader::LoadIndexed(const std::string& theInfile)
+{
+	himan::logger logr("gribloader");
+
+	const int fd = open(theInfile.c_str(), O_RDONLY);
+
+	if (fd == -1)
+	{
+		throw std::runtime_error(fmt::format("Unable to open file '{}'", theInfile));
+	}
+
+	const size_t fileSize = std::filesystem::file_size(theInfile);
+
+	himan::timer timer(true);
+
+	auto positions = gribframer::Scan(fd, fileSize);
+
+	timer.Stop();
+
+	// Messages that can not be framed (eg. GRIB1 over 8MB) are not read
+	// from an index. Without shards or priority order the file is loaded
+	// with NFmiGrib instead, which reads them but gives no data to hash.
+
+	if (itsSkipUnchanged && !common::Sharded() && options.priority.empty() &&
+	    std::any_of(positions.begin(), positions.end(),
+	                [](const gribframer::message_position& pos) { return pos.length == 0; }))
+	{
+		logr.Warning(fmt::format(
+		    "File '{}' has messages that can not be hashed (eg. GRIB1 over 8MB), loading all fields", theInfile));
+
+		itsSkipUnchanged = false;
+		close(fd);
+		LoadThreaded(theInfile);
+		return;
+	}
+
+	if (common::Sharded())
+	{
+		const auto range = common::ShardRange(fileSize);
+		const size_t total = positions.size();
+
+		positions.erase(std::remove_if(positions.begin(), positions.end(),
+		                               [&](const gribframer::message_position& pos)
+		                               { return pos.offset < range.first || pos.offset >= range.second; }),
+		                positions.end());
+
+		logr.Info(fmt::format("Shard byte range {}-{}: {} of {} messages, scanned in {} ms", range.first,
+		                      range.second, positions.size(), total, timer.GetTime()));
+	}
+
+	if (!options.priority.empty())
+	{
+		Prioritize(fd, positions);
+	}
+
+	LoadStream([&](BoundedQueue<stream_message>& queue) { ReadPositions(fd, positions, queue); });
+
+	close(fd);
+}
+
+typedef std::vector<std::pair<std::string, bool>> sort_keys;
+
+// Decode sort keys from the header sections of a message, returns false if
+// a key is not found from them
+
+static bool ReadSortKeys(const unsigned char* data, size_t length, const sort_keys& keys, std::vector<long>& values)
+{
+	codes_handle* h = codes_handle_new_from_partial_message(nullptr, data, length);
+
+	if (!h)
+	{
+		return false;
+	}
+
+	values.clear();
+
+	for (const auto& key : keys)
+	{
+		long value;
+
+		if (codes_get_long(h, key.first.c_str(), &value) != CODES_SUCCESS)
+		{
+			break;
+		}
+
+		values.push_back(key.second ? -value : value);
+	}
+
+	codes_handle_delete(h);
+
+	return values.size() == keys.size();
+}
+
+// Order messages by the keys given with --priority, so that for example
+// the first forecast steps of the control member are loaded (and published
+// to ss_state) first. Keys are decoded from the header sections, which are
+// read from the first bytes of each message; only messages with headers
+// that do not fit there or keys that need other sections are read whole.
+// File order is kept between messages with equal keys.
+
+void grid_to_radon::GribLoader::Prioritize(int fd, std::vector<gribframer::message_position>& positions)
+{
+	himan::logger logr("gribloader");
+	himan::timer timer(true);
+
+	std::vector<std::string> names;
+	boost::split(names, options.priority, boost::is_any_of(","));
+
+	sort_keys keys;
+
+	for (const auto& key : names)
+	{
+		const bool descending = (key[0] == '-');
+		keys.emplace_back(descending ? key.substr(1) : key, descending);
+	}
+
+	std::vector<std::vector<long>> values(positions.size());
+	std::vector<unsigned char> data;
+
+	const size_t headerReadSize = 65536;
+	size_t wholeMessages = 0;
+
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		const auto& pos = positions[i];
+
+		data.resize(std::min(pos.length, headerReadSize));
+
+		if (pread(fd, data.data(), data.size(), static_cast<off_t>(pos.offset)) == static_cast<ssize_t>(data.size()))
+		{
+			const size_t headerLength = gribframer::HeaderSectionsLength(data.data(), data.size());
+
+			if (headerLength > 0 && ReadSortKeys(data.data(), headerLength, keys, values[i]))
+			{
+				continue;
+			}
+		}
+
+		wholeMessages++;
+		data.resize(pos.length);
+
+		NFmiGrib reader;
+		std::unique_ptr<FILE> fp;
+
+		if (pread(fd, data.data(), pos.length, static_cast<off_t>(pos.offset)) == static_cast<ssize_t>(pos.length))
+		{
+			fp.reset(fmemopen(data.data(), data.size(), "r"));
+		}
+
+		if (!fp || !reader.Open(std::move(fp)) || !reader.NextMessage())
+		{
+			// Undecodable messages are left last, reading them fails later
+			values[i].assign(keys.size(), std::numeric_limits<long>::max());
+			continue;
+		}
+
+		values[i].clear();
+
+		for (const auto& key : keys)
+		{
+			const long value = reader.Message().GetLongKey(key.first);
+			values[i].push_back(key.second ? -value : value);
+		}
+	}
+
+	std::vector<size_t> order(positions.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return values[a] < values[b]; });
+
+	std::vector<gribframer::message_position> sorted;
+	sorted.reserve(positions.size());
+
+	for (size_t i : order)
+	{
+		sorted.push_back(positions[i]);
+	}
+
+	positions = std::move(sorted);
+
+	timer.Stop();
+
+	logr.Info(fmt::format("Ordered {} messages by '{}' in {} ms, {} messages read whole", positions.size(),
+	                      options.priority, timer.GetTime(), wholeMessages));
+}
+
+void grid_to_radon::GribLoader::ReadPositions(int fd, const std::vector<gribframer::message_position>& positions,
+                                              BoundedQueue<stream_message>& queue)
+{
+	for (const auto& pos : positions)
+	{
+		if (common::StopRequested())
+		{
+			break;
+		}
+
+		if (itsCheckpoint->Enabled() && itsCheckpoint->IsDone(CheckpointItem(pos.message_no, pos.offset)))
+		{
+			g_resumed++;
+			continue;
+		}
+
+		if (pos.length == 0)
+		{
+			himan::logger logr("gribloader");
+			logr.Error(fmt::format("Message {} at offset {} has unsupported or invalid length (eg. GRIB1 over 8MB)",
+			                       pos.message_no, pos.offset));
+			g_failed++;
+			continue;
+		}
+
+		stream_message msg;
+		msg.message_no = pos.message_no;
+		msg.offset = pos.offset;
+		msg.data.resize(pos.length);
+
+		size_t nread = 0;
+
+		while (nread < pos.length)
+		{
+			const ssize_t ret = pread(fd, msg.data.data() + nread, pos.length - nread,
+			                          static_cast<off_t>(pos.offset + nread));
+
+			if (ret <= 0)
+			{
+				break;
+			}
+
+			nread += static_cast<size_t>(ret);
+		}
+
+		if (nread != pos.length)
+		{
+			himan::logger logr("gribloader");
+			logr.Error(fmt::format("Unable to read message {} at offset {}", pos.message_no, pos.offset));
+			g_failed++;
+			continue;
+		}
+
+		queue.Push(std::move(msg));
+	}
+}
+
 std::pair<std::shared_ptr<himan::configuration>, std::shared_ptr<himan::info<double>>> ReadMetadata(
-    const NFmiGribMessage& message)
+    const NFmiGribMessage& message, bool readData)
 {
 	auto gribpl = GET_PLUGIN(grib);
 
@@ -124,7 +818,7 @@ std::pair<std::shared_ptr<himan::configuration>, std::shared_ptr<himan::info<dou
 	himan::plugin::search_options opts(himan::forecast_time(), himan::param(), himan::level(), himan::producer(),
 	                                   std::make_shared<himan::plugin_configuration>(*config));
 
-	if (gribpl->CreateInfoFromGrib<double>(opts, false, true, info, message, false) == false ||
+	if (gribpl->CreateInfoFromGrib<double>(opts, false, true, info, message, readData) == false ||
 	    info->Producer().Id() == himan::kHPMissingInt)
 	{
 		throw himan::kFileMetaDataNotFound;
@@ -163,6 +857,131 @@ std::pair<std::shared_ptr<himan::configuration>, std::shared_ptr<himan::info<dou
 	return make_pair(config, info);
 }
 
+// Data is decoded only when field statistics are needed for all fields;
+// fields needed for hybrid level heights are decoded again when found
+
+std::pair<std::shared_ptr<himan::configuration>, std::shared_ptr<himan::info<double>>> ReadMetadata(
+    const NFmiGribMessage& message)
+{
+	auto metadata = ReadMetadata(message, options.field_stats);
+
+	if (options.hybrid_level_height && !options.field_stats &&
+	    grid_to_radon::HybridLevelHeight::Wanted(*metadata.second))
+	{
+		metadata = ReadMetadata(message, true);
+	}
+
+	return metadata;
+}
+
+// Thread cpu time in microseconds
+
+static size_t ThreadCPUTime()
+{
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return static_cast<size_t>(ts.tv_sec) * 1000000 + static_cast<size_t>(ts.tv_nsec) / 1000;
+}
+
+// Repack simple packed grib2 message with lossless ccsds (template 5.42) compression.
+// Data values and their precision are not changed, only the way they are encoded.
+
+void grid_to_radon::GribLoader::Repack(NFmiGribMessage& message, short threadId, unsigned int messageNo)
+{
+	if (!options.grib2_ccsds || options.dry_run || message.Edition() != 2 || message.PackingType() != "grid_simple")
+	{
+		return;
+	}
+
+	const size_t inputLength = static_cast<size_t>(message.GetLongKey("totalLength"));
+	const size_t start = ThreadCPUTime();
+
+	message.PackingType("grid_ccsds");
+
+	const size_t cpuTime = ThreadCPUTime() - start;
+	const size_t outputLength = static_cast<size_t>(message.GetLongKey("totalLength"));
+
+	g_repacked++;
+	g_repackInputBytes += inputLength;
+	g_repackOutputBytes += outputLength;
+	g_repackTime += cpuTime;
+
+	himan::logger logr("gribloader#" + to_string(threadId));
+	logr.Trace(fmt::format("Message {} repacked to ccsds: {} -> {} bytes (ratio {:.2f}) cpu time {} us", messageNo,
+	                       inputLength, outputLength,
+	                       static_cast<double>(inputLength) / static_cast<double>(outputLength), cpuTime));
+}
+
+// Consolidated file name is unique to this run, so that no other process
+// appends to it and offsets can be tracked in memory
+
+std::string grid_to_radon::GribLoader::ConsolidatedFileName(std::shared_ptr<himan::configuration>& config,
+                                                            std::shared_ptr<himan::info<double>>& info, long edition)
+{
+	return fmt::format("{}/{}/{}/{}/{}.{}", options.consolidated_output_dir, info->Producer().Id(),
+	                   info->Time().OriginDateTime().String("%Y%m%d%H%M"), config->TargetGeomName(), itsRunId,
+	                   (edition == 2) ? "grib2" : "grib");
+}
+
+void grid_to_radon::GribLoader::WriteConsolidated(NFmiGribMessage& message, const std::string& theFileName,
+                                                  himan::file_information& finfo)
+{
+	consolidated_file* file = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(itsConsolidatedMutex);
+
+		auto& ptr = itsConsolidatedFiles[theFileName];
+
+		if (!ptr)
+		{
+			ptr = std::make_unique<consolidated_file>();
+
+			if (!options.dry_run)
+			{
+				grid_to_radon::common::CreateDirectory(theFileName);
+
+				// File must not exist: registered offsets are valid only if
+				// this loader is the only writer
+
+				const int fd = open(theFileName.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+				if (fd == -1)
+				{
+					const int err = errno;
+					itsConsolidatedFiles.erase(theFileName);
+					throw std::runtime_error(
+					    fmt::format("Unable to create file '{}': {}", theFileName, std::strerror(err)));
+				}
+
+				close(fd);
+			}
+		}
+
+		file = ptr.get();
+	}
+
+	std::lock_guard<std::mutex> lock(file->mutex);
+
+	if (!options.dry_run)
+	{
+		// Offset of the message is the real end of file before appending
+		file->offset = std::filesystem::file_size(theFileName);
+	}
+
+	finfo.offset = file->offset;
+	finfo.message_no = file->message_no;
+
+	if (!options.dry_run && !message.Write(theFileName, true))
+	{
+		throw std::runtime_error("Message write failed");
+	}
+
+	file->offset += finfo.length;
+	file->message_no++;
+}
+
 void WriteMessage(NFmiGribMessage& message, const std::string& theFileName)
 {
 	if (!options.dry_run && !options.in_place_insert)
@@ -176,45 +995,94 @@ void WriteMessage(NFmiGribMessage& message, const std::string& theFileName)
 	}
 }
 
-void grid_to_radon::GribLoader::Process(NFmiGribMessage& message, short threadId, unsigned int messageNo)
+void grid_to_radon::GribLoader::Process(NFmiGribMessage& message, short threadId, unsigned int messageNo,
+                                        unsigned long offset, const std::vector<unsigned char>& data)
 {
 	himan::timer msgtimer(true);
 	himan::logger logr("gribloader#" + to_string(threadId));
 
 	try
 	{
+		if (!itsFilter.Matches(message))
+		{
+			g_skipped++;
+			logr.Trace(fmt::format("Message {} excluded by filter", messageNo));
+			return;
+		}
+
 		auto metadata = ReadMetadata(message);
 
 		auto config = metadata.first;
 		auto info = metadata.second;
 
-		const string theFileName = grid_to_radon::common::MakeFileName(config, info, itsInputFileName);
+		const bool consolidated = !options.consolidated_output_dir.empty();
+		const string theFileName = (consolidated) ? ConsolidatedFileName(config, info, message.Edition())
+		                                          : grid_to_radon::common::MakeFileName(config, info, itsInputFileName);
 
-		himan::timer tmr(true);
+		auto r = GET_PLUGIN(radon);
 
-		WriteMessage(message, theFileName);
+		// Skip writing and registering the field if it has already been
+		// registered with identical data
 
-		tmr.Stop();
-		const size_t writeTime = tmr.GetTime();
+		std::string hashKey;
+		uint64_t hash = 0;
 
-		tmr.Start();
+		if (itsSkipUnchanged)
+		{
+			hashKey = grid_to_radon::common::HashKey(config, info);
+			hash = grid_to_radon::common::HashMessage(data);
 
-		auto r = GET_PLUGIN(radon);
+			auto rec = grid_to_radon::common::FindUnchanged(config, info, r, hashKey, hash, theFileName);
+
+			if (rec)
+			{
+				g_unchanged++;
+
+				logr.Debug(fmt::format("Message {} {} unchanged", messageNo,
+				                       grid_to_radon::common::FormatInfoToString(info)));
+
+				Complete(config, info, rec.value(), messageNo, offset);
+				return;
+			}
+		}
+
+		himan::timer tmr(true);
+
+		Repack(message, threadId, messageNo);
 
 		himan::file_information finfo;
 		finfo.storage_type = himan::kLocalFileSystem;
 		finfo.message_no = (options.in_place_insert) ? messageNo : 0;
-		finfo.offset = (options.in_place_insert) ? itsReader.Offset(messageNo) : 0UL;
+		finfo.offset = (options.in_place_insert) ? offset : 0UL;
 		finfo.length = static_cast<unsigned long>(message.GetLongKey("totalLength"));
 		finfo.file_location = theFileName;
 		finfo.file_type = static_cast<himan::HPFileType>(message.Edition());
 
+		if (consolidated)
+		{
+			WriteConsolidated(message, theFileName, finfo);
+		}
+		else
+		{
+			WriteMessage(message, theFileName);
+		}
+
+		tmr.Stop();
+		const size_t writeTime = tmr.GetTime();
+
+		tmr.Start();
+
 		if (info->Param().Name() != "XX-X")
 		{
 			auto ret = grid_to_radon::common::SaveToDatabase(config, info, r, finfo);
 
 			if (ret.first)
 			{
+				if (itsSkipUnchanged)
+				{
+					grid_to_radon::common::SaveHash(r, hashKey, hash, ret.second);
+				}
+
 				tmr.Stop();
 				const size_t databaseTime = tmr.GetTime();
 
@@ -224,16 +1092,15 @@ void grid_to_radon::GribLoader::Process(NFmiGribMessage& message, short threadId
 				const size_t messageTime = msgtimer.GetTime();
 				const size_t otherTime = messageTime - writeTime - databaseTime;
 
+				itsController.StageTimes(otherTime, writeTime, databaseTime);
+
 				auto logmsg = fmt::format("Message {} {} write time={} dbtime={} other={} total={} ms", messageNo,
 				                          grid_to_radon::common::FormatInfoToString(info), writeTime, databaseTime,
 				                          otherTime, messageTime);
 
 				logr.Debug(logmsg);
 
-				{
-					std::lock_guard<std::mutex> lock(recordUpdateMutex);
-					itsRecords.push_back(ret.second);
-				}
+				Complete(config, info, ret.second, messageNo, offset);
 			}
 			else
 			{
@@ -264,3 +1131,36 @@ void grid_to_radon::GribLoader::Process(NFmiGribMessage& message, short threadId
 		g_failed++;
 	}
 }
+
+// Bookkeeping of a field that is registered to radon, either now or by an
+// earlier load with identical data
+
+void grid_to_radon::GribLoader::Complete(std::shared_ptr<himan::configuration>& config,
+                                         std::shared_ptr<himan::info<double>>& info, record& rec,
+                                         unsigned int messageNo, unsigned long offset)
+{
+	const bool hybridLevelHeight = itsHybridLevelHeight && HybridLevelHeight::Wanted(*info);
+
+	if (options.field_stats || hybridLevelHeight)
+	{
+		rec.stats = fieldstats::Compute(info->Data().Values());
+	}
+
+	if (hybridLevelHeight)
+	{
+		itsHybridLevelHeight->Add(*info, config->TargetGeomName(), rec.stats);
+	}
+
+	itsSink->Add(rec);
+	itsCollected.Add(rec);
+
+	if (itsPublisher)
+	{
+		itsPublisher->Add(rec);
+	}
+
+	if (itsCheckpoint->Enabled())
+	{
+		itsCheckpoint->Done(CheckpointItem(messageNo, offset), rec);
+	}
+}
@@ -0,0 +1,189 @@
+#include "hybridlevelheight.h"
+#include "logger.h"
+#include "options.h"
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <cmath>
+#include <numeric>
+#include <plugin_factory.h>
+
+#define HIMAN_AUXILIARY_INCLUDE
+#include "radon.h"
+#undef HIMAN_AUXILIARY_INCLUDE
+
+extern grid_to_radon::Options options;
+
+using namespace grid_to_radon;
+
+namespace
+{
+const char* kParams[] = {"P-HPA", "HL-M"};
+
+// Same selection as in calc_hybrid_level_height.py: ensemble producers use
+// perturbed members, others the deterministic forecast
+
+himan::HPForecastType ForecastType(long producerId)
+{
+	return (producerId == 243 || producerId == 260) ? himan::kEpsPerturbation : himan::kDeterministic;
+}
+
+double Round(double value)
+{
+	return std::round(value * 10) / 10;
+}
+
+// Sample standard deviation, zero for less than two values
+double StdDev(const std::vector<double>& values)
+{
+	if (values.size() < 2)
+	{
+		return 0;
+	}
+
+	const double mean = std::accumulate(values.begin(), values.end(), 0.) / static_cast<double>(values.size());
+	double sum = 0;
+
+	for (double value : values)
+	{
+		sum += (value - mean) * (value - mean);
+	}
+
+	return std::sqrt(sum / static_cast<double>(values.size() - 1));
+}
+
+double Mean(const std::vector<double>& values)
+{
+	return std::accumulate(values.begin(), values.end(), 0.) / static_cast<double>(values.size());
+}
+
+// Level type the producer uses for hybrid levels, from producer_meta
+std::string HybridLevelType(std::shared_ptr<himan::plugin::radon>& r, long producerId)
+{
+	r->RadonDB().Query(fmt::format(
+	    "SELECT value FROM producer_meta WHERE producer_id = {} AND attribute = 'hybrid level type'", producerId));
+
+	const auto row = r->RadonDB().FetchRow();
+
+	return row.empty() ? "hybrid" : boost::to_lower_copy(row[0]);
+}
+}  // namespace
+
+bool HybridLevelHeight::Wanted(const himan::info<double>& info)
+{
+	const std::string& name = info.Param().Name();
+
+	return (name == kParams[0] || name == kParams[1]) &&
+	       info.ForecastType().Type() == ForecastType(info.Producer().Id()) && info.Time().Step().Hours() <= 24;
+}
+
+void HybridLevelHeight::Add(const himan::info<double>& info, const std::string& geometryName, const field_stats& stats)
+{
+	if (stats.missing == stats.count)
+	{
+		return;
+	}
+
+	const size_t index = (info.Param().Name() == kParams[0]) ? 0 : 1;
+
+	const level_key key(info.Producer().Id(), geometryName, info.Time().OriginDateTime().ToSQLTime(),
+	                    info.Level().Type(), static_cast<int>(info.Level().Value()));
+
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	auto& level = itsLevels[index][key];
+	level.min.push_back(stats.min);
+	level.max.push_back(stats.max);
+	level.mean.push_back(stats.mean);
+}
+
+void HybridLevelHeight::Disable(const std::string& reason)
+{
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	if (itsDisabledReason.empty())
+	{
+		itsDisabledReason = reason;
+	}
+}
+
+int HybridLevelHeight::Save()
+{
+	himan::logger logr("hybridlevelheight");
+
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	if (!itsDisabledReason.empty())
+	{
+		logr.Warning(fmt::format("Hybrid level heights not written: {}", itsDisabledReason));
+		return 0;
+	}
+
+	if (itsLevels[0].empty())
+	{
+		return 0;
+	}
+
+	auto r = GET_PLUGIN(radon);
+
+	std::map<long, std::string> levelTypes;
+	int count = 0;
+
+	for (const auto& item : itsLevels[0])
+	{
+		const auto& key = item.first;
+		const long producerId = std::get<0>(key);
+
+		if (levelTypes.count(producerId) == 0)
+		{
+			levelTypes[producerId] = HybridLevelType(r, producerId);
+		}
+
+		if (himan::HPLevelTypeToString.at(std::get<3>(key)) != levelTypes[producerId])
+		{
+			continue;
+		}
+
+		const auto height = itsLevels[1].find(key);
+
+		if (height == itsLevels[1].end())
+		{
+			logr.Warning(fmt::format("No height data for level {}", std::get<4>(key)));
+			continue;
+		}
+
+		const auto& p = item.second;
+		const auto& h = height->second;
+
+		const std::string query = fmt::format(
+		    "INSERT INTO hybrid_level_height AS h (producer_id, geometry_id, level_value, analysis_time, "
+		    "minimum_height, minimum_height_stddev, minimum_pressure, minimum_pressure_stddev, maximum_height, "
+		    "maximum_height_stddev, maximum_pressure, maximum_pressure_stddev, average_height, average_pressure, "
+		    "count) VALUES ({}, (SELECT id FROM geom WHERE name = '{}'), {}, '{}', {}, {}, {}, {}, {}, {}, {}, {}, "
+		    "{}, {}, {}) ON CONFLICT (producer_id, geometry_id, level_value) DO UPDATE SET analysis_time = "
+		    "EXCLUDED.analysis_time, minimum_height = EXCLUDED.minimum_height, minimum_height_stddev = "
+		    "EXCLUDED.minimum_height_stddev, minimum_pressure = EXCLUDED.minimum_pressure, minimum_pressure_stddev = "
+		    "EXCLUDED.minimum_pressure_stddev, maximum_height = EXCLUDED.maximum_height, maximum_height_stddev = "
+		    "EXCLUDED.maximum_height_stddev, maximum_pressure = EXCLUDED.maximum_pressure, maximum_pressure_stddev = "
+		    "EXCLUDED.maximum_pressure_stddev, average_height = EXCLUDED.average_height, average_pressure = "
+		    "EXCLUDED.average_pressure, count = EXCLUDED.count",
+		    producerId, std::get<1>(key), std::get<4>(key), std::get<2>(key),
+		    Round(*std::min_element(h.min.begin(), h.min.end())), Round(StdDev(h.min)),
+		    Round(*std::min_element(p.min.begin(), p.min.end())), Round(StdDev(p.min)),
+		    Round(*std::max_element(h.max.begin(), h.max.end())), Round(StdDev(h.max)),
+		    Round(*std::max_element(p.max.begin(), p.max.end())), Round(StdDev(p.max)), Round(Mean(h.mean)),
+		    Round(Mean(p.mean)), p.min.size());
+
+		if (options.dry_run)
+		{
+			logr.Trace(query);
+			continue;
+		}
+
+		r->RadonDB().Execute(query);
+		count++;
+	}
+
+	logr.Info(fmt::format("Wrote {} rows to hybrid_level_height", count));
+
+	return count;
+}
@@ -1,23 +1,37 @@
 #include "netcdfloader.h"
 #include "NFmiNetCDF.h"
+#include "checkpoint.h"
 #include "common.h"
+#include "fieldstats.h"
 #include "filename.h"
 #include "info.h"
 #include "lambert_conformal_grid.h"
 #include "latitude_longitude_grid.h"
+#include "netcdfreadplanner.h"
+#include "netcdfslice.h"
+#include "netcdfwriter.h"
 #include "options.h"
 #include "plugin_factory.h"
+#include "s3.h"
 #include "timer.h"
 #include "util.h"
 #include <algorithm>
 #include <atomic>
 #include <boost/algorithm/string.hpp>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
 #include <ctime>
 #include <iomanip>
+#include <limits>
+#include <netcdf.h>
 #include <ogr_spatialref.h>
+#include <optional>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #define HIMAN_AUXILIARY_INCLUDE
 #include "radon.h"
@@ -34,6 +48,115 @@ std::map<std::string, short> pskip;
 
 himan::raw_time StringToTime(const std::string& dateTime, const std::string& mask);
 
+// Input file opened once for --field-stats, slices of all variables are
+// read through the same handle.
+
+struct StatsFile
+{
+	explicit StatsFile(const std::string& theFileName)
+	{
+		if (nc_open(theFileName.c_str(), NC_NOWRITE, &ncid) != NC_NOERR)
+		{
+			ncid = -1;
+		}
+	}
+
+	StatsFile(const StatsFile&) = delete;
+	StatsFile& operator=(const StatsFile&) = delete;
+
+	~StatsFile()
+	{
+		if (ncid != -1)
+		{
+			nc_close(ncid);
+		}
+	}
+
+	std::vector<double> ReadSlice(const std::string& varName, size_t timeIndex, size_t levelIndex) const;
+
+	int ncid = -1;
+};
+
+// Values of one 2D slice of a variable. Dimensions of the variable before
+// the last two are indexed with the time index if they are the record
+// dimension or named 'time', otherwise with the level index. Fill and missing
+// values are returned as NaN, scale factor and offset are applied.
+
+std::vector<double> StatsFile::ReadSlice(const std::string& varName, size_t timeIndex, size_t levelIndex) const
+{
+	int varid, ndims, unlimdim;
+	int dimids[NC_MAX_VAR_DIMS];
+
+	if (ncid == -1 || nc_inq_varid(ncid, varName.c_str(), &varid) != NC_NOERR ||
+	    nc_inq_var(ncid, varid, nullptr, nullptr, &ndims, dimids, nullptr) != NC_NOERR || ndims < 2)
+	{
+		return std::vector<double>();
+	}
+
+	nc_inq_unlimdim(ncid, &unlimdim);
+
+	std::vector<size_t> start(static_cast<size_t>(ndims), 0), count(static_cast<size_t>(ndims), 1);
+	size_t size = 1;
+
+	for (size_t i = 0; i < static_cast<size_t>(ndims); i++)
+	{
+		size_t len;
+		char name[NC_MAX_NAME + 1];
+		nc_inq_dim(ncid, dimids[i], name, &len);
+
+		if (i + 2 >= static_cast<size_t>(ndims))
+		{
+			count[i] = len;
+			size *= len;
+		}
+		else if (dimids[i] == unlimdim || std::string(name) == "time")
+		{
+			start[i] = std::min(timeIndex, len - 1);
+		}
+		else
+		{
+			start[i] = std::min(levelIndex, len - 1);
+		}
+	}
+
+	std::vector<double> values(size);
+
+	if (nc_get_vara_double(ncid, varid, start.data(), count.data(), values.data()) != NC_NOERR)
+	{
+		return std::vector<double>();
+	}
+
+	double scale = 1, offset = 0;
+	nc_get_att_double(ncid, varid, "scale_factor", &scale);
+	nc_get_att_double(ncid, varid, "add_offset", &offset);
+
+	std::vector<double> missing;
+
+	for (const char* att : {"_FillValue", "missing_value"})
+	{
+		double value;
+
+		if (nc_get_att_double(ncid, varid, att, &value) == NC_NOERR)
+		{
+			missing.push_back(value);
+		}
+	}
+
+	for (auto& value : values)
+	{
+		if (std::find(missing.begin(), missing.end(), value) != missing.end())
+		{
+			value = std::numeric_limits<double>::quiet_NaN();
+		}
+		else
+		{
+			value = value * scale + offset;
+		}
+	}
+
+	return values;
+}
+
 NetCDFLoader::NetCDFLoader() : itsLogger("netcdf")
 {
 	// StringToTime() function handles UTC only
@@ -45,6 +168,80 @@ NetCDFLoader::NetCDFLoader() : itsLogger("netcdf")
 	itsHostName = std::string(myhost);
 }
 
+// Anonymous memory backed file. NFmiNetCDF only opens files by name, so
+// an object read from s3 is given to it through /proc/self/fd without
+// touching local disk.
+
+struct MemoryFile
+{
+	MemoryFile() = default;
+	MemoryFile(const MemoryFile&) = delete;
+	MemoryFile& operator=(const MemoryFile&) = delete;
+
+	~MemoryFile()
+	{
+		if (fd != -1)
+		{
+			close(fd);
+		}
+	}
+
+	std::string Path() const
+	{
+		return fmt::format("/proc/self/fd/{}", fd);
+	}
+
+	int fd = -1;
+};
+
+bool ReadFromS3(const std::string& theInfile, MemoryFile& mfile)
+{
+	himan::file_information finfo;
+	finfo.message_no = std::nullopt;
+	finfo.offset = 0;
+	finfo.length = himan::s3::ObjectSize(theInfile);
+	finfo.storage_type = himan::kS3ObjectStorageSystem;
+	finfo.file_location = theInfile;
+
+	const char* host = getenv("S3_HOSTNAME");
+
+	if (!host)
+	{
+		throw std::runtime_error("Environment variable S3_HOSTNAME not defined");
+	}
+
+	finfo.file_server = host;
+
+	auto buffer = himan::s3::ReadFile(finfo);
+
+	mfile.fd = memfd_create("grid_to_radon", MFD_CLOEXEC);
+
+	if (mfile.fd == -1)
+	{
+		return false;
+	}
+
+	size_t written = 0;
+
+	while (written < buffer.length)
+	{
+		const ssize_t ret = write(mfile.fd, buffer.data + written, buffer.length - written);
+
+		if (ret == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+
+		written += static_cast<size_t>(ret);
+	}
+
+	return true;
+}
+
 himan::raw_time ReadTime(const std::string& analysistime)
 {
 	std::string mask = "%Y%m%d%H";
@@ -170,26 +367,54 @@ himan::param ReadParam(NFmiNetCDF& reader, const himan::producer& prod)
 	return himan::param(parameter["name"]);
 }
 
-std::pair<bool, records> NetCDFLoader::Load(const std::string& theInfile) const
+bool NetCDFLoader::Load(const std::string& theInfile, RecordSink& sink) const
 {
+	MemoryFile mfile;
+	std::string readFileName = theInfile;
+
+	if (options.s3)
+	{
+		himan::timer timer(true);
+
+		if (!ReadFromS3(theInfile, mfile))
+		{
+			itsLogger.Error(fmt::format("Unable to read file '{}' to memory: {}", theInfile, strerror(errno)));
+			return false;
+		}
+
+		timer.Stop();
+		itsLogger.Debug(fmt::format("Read file '{}' from s3 in {} ms", theInfile, timer.GetTime()));
+
+		readFileName = mfile.Path();
+	}
+
+	// Chunk cache must be set before the file is opened
+
+	NetCDFReadPlanner planner;
+
+	if (planner.Plan(readFileName))
+	{
+		planner.Apply();
+	}
+
 	NFmiNetCDF reader;
 
-	if (!reader.Read(theInfile))
+	if (!reader.Read(readFileName))
 	{
 		itsLogger.Error("Unable to read file '" + theInfile + "'");
-		return make_pair(false, records{});
+		return false;
 	}
 
 	if (options.analysistime.empty())
 	{
 		itsLogger.Error("Analysistime not specified");
-		return make_pair(false, records{});
+		return false;
 	}
 
 	if (!reader.IsConvention())
 	{
 		itsLogger.Error("File '" + theInfile + "' is not CF conforming NetCDF");
-		return make_pair(false, records{});
+		return false;
 	}
 
 	itsLogger.Debug("Read " + std::to_string(reader.SizeZ()) + " levels,\n" + +"     " +
@@ -202,7 +427,7 @@ std::pair<bool, records> NetCDFLoader::Load(const std::string& theInfile) const
 	if (options.producer == 0)
 	{
 		itsLogger.Error("producer_id value not found");
-		return make_pair(false, records{});
+		return false;
 	}
 
 	const himan::producer prod(options.producer);
@@ -211,7 +436,7 @@ std::pair<bool, records> NetCDFLoader::Load(const std::string& theInfile) const
 	{
 		itsLogger.Error("Invalid format for analysistime: " + options.analysistime);
 		itsLogger.Error("Use YYYYMMDDHH24[MI]");
-		return make_pair(false, records{});
+		return false;
 	}
 
 	const himan::raw_time originTime = ReadTime(options.analysistime);
@@ -226,7 +451,7 @@ std::pair<bool, records> NetCDFLoader::Load(const std::string& theInfile) const
 	if (geomdef.empty())
 	{
 		itsLogger.Error("Did not find geometry from database");
-		return make_pair(false, records{});
+		return false;
 	}
 
 	auto config = std::make_shared<himan::configuration>();
@@ -260,9 +485,38 @@ std::pair<bool, records> NetCDFLoader::Load(const std::string& theInfile) const
 		return info;
 	};
 
-	auto Write = [&](std::shared_ptr<himan::info<double>>& info) -> std::pair<bool, record>
+	netcdfwriter::write_stats writeStats;
+
+	// timeIndex and levelIndex identify the 2D hyperslab of the current variable. With in-place insert
+	// they are stored with the variable name as described in netcdfslice.h, so that the slice can be
+	// read directly from the original file.
+
+	Checkpoint checkpoint(theInfile);
+	int resumedSlices = 0;
+
+	std::optional<StatsFile> statsFile;
+
+	if (options.field_stats)
 	{
-		const std::string theFileName = common::MakeFileName(config, info, "");
+		statsFile.emplace(readFileName);
+	}
+
+	// Input file is open; files written during the load get default caches
+
+	planner.Restore();
+
+	auto Write = [&](std::shared_ptr<himan::info<double>>& info, size_t timeIndex, size_t levelIndex)
+	    -> std::pair<bool, record>
+	{
+		const std::string item = fmt::format("{}:{}:{}", reader.Param()->name(), timeIndex, levelIndex);
+
+		if (checkpoint.IsDone(item))
+		{
+			resumedSlices++;
+			return std::make_pair(false, record());
+		}
+
+		const std::string theFileName = common::MakeFileName(config, info, theInfile);
 
 		himan::file_information finfo;
 		finfo.file_type = himan::kNetCDF;
@@ -273,16 +527,75 @@ std::pair<bool, records> NetCDFLoader::Load(const std::string& theInfile) const
 		finfo.length = std::nullopt;
 		finfo.storage_type = himan::kLocalFileSystem;
 
-		if (!options.dry_run)
+		if (options.s3 || options.in_place_insert)
 		{
-			if (!reader.WriteSlice(finfo.file_location))
+			// s3 objects are always registered in-place
+
+			if (options.s3)
+			{
+				finfo.storage_type = himan::kS3ObjectStorageSystem;
+				finfo.file_location = common::StripProtocol(theFileName);
+				finfo.file_server = getenv("S3_HOSTNAME");
+			}
+
+			const netcdfslice::slice slice{finfo.file_location, reader.Param()->name(), timeIndex, levelIndex};
+			const auto fileLocation = netcdfslice::FileLocation(slice);
+
+			if (!fileLocation)
+			{
+				itsLogger.Error(fmt::format("Slice {}/{} of variable '{}' can not be registered in-place", timeIndex,
+				                            levelIndex, slice.variable));
+				return std::make_pair(false, record());
+			}
+
+			finfo.file_location = fileLocation.value();
+			finfo.message_no = netcdfslice::MessageNo(slice);
+		}
+		else if (!options.dry_run)
+		{
+			if (netcdfwriter::Enabled())
+			{
+				// fminc writes slices with fixed settings; write to temporary
+				// file and repack that with requested compression and chunking
+
+				himan::timer timer(true);
+				const std::string tmpFileName = finfo.file_location + ".tmp";
+
+				if (!reader.WriteSlice(tmpFileName))
+				{
+					itsLogger.Error("Write to file failed");
+					return std::make_pair(false, record());
+				}
+
+				netcdfwriter::write_stats stats;
+				const bool repacked = netcdfwriter::Repack(tmpFileName, finfo.file_location, stats);
+
+				std::remove(tmpFileName.c_str());
+
+				if (!repacked)
+				{
+					itsLogger.Error("Repacking of file failed");
+					return std::make_pair(false, record());
+				}
+
+				timer.Stop();
+
+				writeStats.input_size += stats.input_size;
+				writeStats.output_size += stats.output_size;
+				writeStats.write_time += timer.GetTime();
+				writeStats.read_time += stats.read_time;
+
+				itsLogger.Debug(fmt::format("Repacked {} bytes to {} bytes, write time={} ms read time={} ms",
+				                            stats.input_size, stats.output_size, timer.GetTime(), stats.read_time));
+			}
+			else if (!reader.WriteSlice(finfo.file_location))
 			{
 				itsLogger.Error("Write to file failed");
 				return std::make_pair(false, record());
 			}
 		}
 
-		const auto ret = grid_to_radon::common::SaveToDatabase(config, info, r, finfo);
+		auto ret = grid_to_radon::common::SaveToDatabase(config, info, r, finfo);
 
 		if (options.dry_run == false && ret.first == false)
 		{
@@ -290,12 +603,18 @@ std::pair<bool, records> NetCDFLoader::Load(const std::string& theInfile) const
 			return std::make_pair(false, record());
 		}
 
+		if (statsFile)
+		{
+			ret.second.stats = fieldstats::Compute(statsFile->ReadSlice(reader.Param()->name(), timeIndex, levelIndex));
+		}
+
 		itsLogger.Debug(
 		    fmt::format("Wrote {} level {} to file '{}'", info->Param().Name(), info->Level(), finfo.file_location));
 
 		if (options.dry_run == false)
 		{
-			return std::make_pair(true, ret.second);
+			checkpoint.Done(item, ret.second);
+			return std::make_pair(true, std::move(ret.second));
 		}
 
 		return std::make_pair(false, record());
@@ -303,113 +622,202 @@ std::pair<bool, records> NetCDFLoader::Load(const std::string& theInfile) const
 
 	const himan::forecast_type ftype(himan::kDeterministic);
 
-	records recs;
+	SSStateCollector collected;
 
-	for (reader.ResetTime(); reader.NextTime();)
+	auto Add = [&](const record& rec)
 	{
-		const himan::raw_time validTime = ReadValidTime(reader);
+		sink.Add(rec);
+		collected.Add(rec);
+	};
 
-		if (validTime == himan::raw_time())
-		{
-			itsLogger.Warning("Unable to determine valid time from file");
-			continue;
-		}
+	// Read all slices of current parameter and time
 
-		const himan::forecast_time ftime(originTime, validTime);
+	auto LoadParam = [&](const himan::param& par, const himan::forecast_time& ftime, unsigned long timeIndex)
+	{
+		himan::level lvl;
 
-		reader.FirstParam();
+		// Check level type
 
-		do
+		if (options.level.empty())
 		{
-			const himan::param par = ReadParam(reader, prod);
-
-			if (par == himan::param())
-			{
-				continue;
-			}
-
-			himan::level lvl;
+			// Default
+			lvl = himan::level(himan::kHeight, 0);
+		}
+		else
+		{
+			lvl = himan::level(himan::HPStringToLevelType.at(boost::to_lower_copy(options.level)), 0);
+		}
 
-			// Check level type
+		if (!reader.HasDimension("z"))
+		{
+			// This parameter has no z dimension --> map to level 0
 
-			if (options.level.empty())
+			himan::timer timer(true);
+			auto info = CreateInfo(ftype, ftime, lvl, himan::util::InitializeParameter(prod, par, lvl));
+			const auto ret = Write(info, timeIndex, 0);
+			if (ret.first)
 			{
-				// Default
-				lvl = himan::level(himan::kHeight, 0);
+				Add(ret.second);
 			}
-			else
+			timer.Stop();
+			itsLogger.Info(
+			    fmt::format("{} total {} ms", grid_to_radon::common::FormatInfoToString(info), timer.GetTime()));
+		}
+		else
+		{
+			int truncate_digits = 6;
+			auto truncate_digits_env = getenv("GRID_TO_RADON_TRUNCATE_LEVEL_VALUE_DIGITS");
+
+			if (truncate_digits_env)
 			{
-				lvl = himan::level(himan::HPStringToLevelType.at(boost::to_lower_copy(options.level)), 0);
+				truncate_digits = std::stoi(truncate_digits_env);
 			}
 
-			if (!reader.HasDimension("z"))
+			auto scaler = std::pow(10, truncate_digits);
+
+			for (reader.ResetLevel(); reader.NextLevel() && !common::StopRequested();)
 			{
-				// This parameter has no z dimension --> map to level 0
+				if (options.use_level_value)
+				{
+					double lvl_value = static_cast<double>(reader.Level());
+					lvl_value = std::round(lvl_value * scaler) / scaler;
+					lvl.Value(lvl_value);
+				}
+				else if (options.use_inverse_level_value)
+				{
+					lvl.Value(reader.Level() * -1);
+				}
+				else
+				{
+					lvl.Value(static_cast<float>(reader.LevelIndex()));  // ordering number
+				}
 
 				himan::timer timer(true);
 				auto info = CreateInfo(ftype, ftime, lvl, himan::util::InitializeParameter(prod, par, lvl));
-				const auto ret = Write(info);
+				const size_t levelIndex = static_cast<size_t>(reader.LevelIndex());
+				const auto ret = Write(info, timeIndex, levelIndex);
+
 				if (ret.first)
 				{
-					recs.push_back(ret.second);
+					Add(ret.second);
 				}
 				timer.Stop();
-				itsLogger.Info(
-				    fmt::format("{} total {} ms", grid_to_radon::common::FormatInfoToString(info), timer.GetTime()));
+				itsLogger.Info(fmt::format("{} total {} ms", grid_to_radon::common::FormatInfoToString(info),
+				                           timer.GetTime()));
+			}
+		}
+		g_succeededParams++;
+	};
+
+	auto ReadForecastTime = [&]() -> himan::forecast_time
+	{
+		const himan::raw_time validTime = ReadValidTime(reader);
+
+		if (validTime == himan::raw_time())
+		{
+			itsLogger.Warning("Unable to determine valid time from file");
+			return himan::forecast_time();
+		}
+
+		return himan::forecast_time(originTime, validTime);
+	};
+
+	if (planner.Order() == NetCDFReadOrder::kTimeMajor)
+	{
+		unsigned long timeIndex = 0;
+
+		for (reader.ResetTime(); reader.NextTime() && !common::StopRequested(); timeIndex++)
+		{
+			const himan::forecast_time ftime = ReadForecastTime();
+
+			if (ftime == himan::forecast_time())
+			{
+				continue;
 			}
-			else
+
+			reader.FirstParam();
+
+			do
 			{
-				int truncate_digits = 6;
-				auto truncate_digits_env = getenv("GRID_TO_RADON_TRUNCATE_LEVEL_VALUE_DIGITS");
+				const himan::param par = ReadParam(reader, prod);
 
-				if (truncate_digits_env)
+				if (par == himan::param())
 				{
-					truncate_digits = std::stoi(truncate_digits_env);
+					continue;
 				}
 
-				auto scaler = std::pow(10, truncate_digits);
+				LoadParam(par, ftime, timeIndex);
+			} while (!common::StopRequested() && reader.NextParam());
+		}
+	}
+	else
+	{
+		reader.FirstParam();
+
+		do
+		{
+			const himan::param par = ReadParam(reader, prod);
 
-				for (reader.ResetLevel(); reader.NextLevel();)
+			if (par == himan::param())
+			{
+				continue;
+			}
+
+			unsigned long timeIndex = 0;
+
+			for (reader.ResetTime(); reader.NextTime() && !common::StopRequested(); timeIndex++)
+			{
+				const himan::forecast_time ftime = ReadForecastTime();
+
+				if (ftime == himan::forecast_time())
 				{
-					if (options.use_level_value)
-					{
-						double lvl_value = static_cast<double>(reader.Level());
-						lvl_value = std::round(lvl_value * scaler) / scaler;
-						lvl.Value(lvl_value);
-					}
-					else if (options.use_inverse_level_value)
-					{
-						lvl.Value(reader.Level() * -1);
-					}
-					else
-					{
-						lvl.Value(static_cast<float>(reader.LevelIndex()));  // ordering number
-					}
-
-					himan::timer timer(true);
-					auto info = CreateInfo(ftype, ftime, lvl, himan::util::InitializeParameter(prod, par, lvl));
-					const auto ret = Write(info);
-
-					if (ret.first)
-					{
-						recs.push_back(ret.second);
-					}
-					timer.Stop();
-					itsLogger.Info(fmt::format("{} total {} ms", grid_to_radon::common::FormatInfoToString(info),
-					                           timer.GetTime()));
+					continue;
 				}
+
+				LoadParam(par, ftime, timeIndex);
 			}
-			g_succeededParams++;
-		} while (reader.NextParam());
+		} while (!common::StopRequested() && reader.NextParam());
 	}
 	itsLogger.Info(
 	    fmt::format("Success with {} params, failed with {} params", int(g_succeededParams), int(g_failedParams)));
 
-	common::UpdateSSState(recs);
+	if (resumedSlices > 0)
+	{
+		itsLogger.Info(fmt::format("Resumed {} slices from checkpoint", resumedSlices));
+	}
+
+	if (common::StopRequested())
+	{
+		checkpoint.Flush();
+		itsLogger.Warning(fmt::format("Loading of file '{}' interrupted", theInfile));
+		return false;
+	}
+
+	if (netcdfwriter::Enabled() && writeStats.input_size > 0)
+	{
+		itsLogger.Info(fmt::format(
+		    "Compressed output {:.1f}MB to {:.1f}MB (ratio {:.2f}), write time={} ms read time={} ms",
+		    static_cast<double>(writeStats.input_size) / 1024. / 1024.,
+		    static_cast<double>(writeStats.output_size) / 1024. / 1024.,
+		    static_cast<double>(writeStats.input_size) / static_cast<double>(std::max<size_t>(1, writeStats.output_size)),
+		    writeStats.write_time, writeStats.read_time));
+	}
+
+	for (const auto& key : checkpoint.ResumedKeys())
+	{
+		collected.Add(key);
+	}
+
+	common::UpdateSSState(collected.Keys());
 
 	const bool retval = common::CheckForFailure(g_failedParams, 0, g_succeededParams);
 
-	return std::make_pair(retval, recs);
+	if (retval)
+	{
+		checkpoint.Remove();
+	}
+
+	return retval;
 }
 
 himan::raw_time StringToTime(const std::string& dateTime, const std::string& mask)
@@ -0,0 +1,239 @@
+#include "netcdfreadplanner.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <netcdf.h>
+#include <vector>
+
+using namespace grid_to_radon;
+
+// Default maximum total size of the chunk caches of all variables. netcdf
+// gives each variable a cache of its own, and caches of variables that have
+// already been read are kept until the file is closed.
+static const size_t kDefaultMaxCacheSize = 256 * 1024 * 1024;
+
+static size_t NextPrime(size_t n)
+{
+	auto IsPrime = [](size_t v)
+	{
+		if (v < 2)
+		{
+			return false;
+		}
+		for (size_t i = 2; i * i <= v; i++)
+		{
+			if (v % i == 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	while (!IsPrime(n))
+	{
+		n++;
+	}
+
+	return n;
+}
+
+static size_t Blocks(size_t len, size_t chunk)
+{
+	return (chunk == 0) ? 1 : (len + chunk - 1) / chunk;
+}
+
+NetCDFReadPlanner::NetCDFReadPlanner()
+    : itsOrder(NetCDFReadOrder::kTimeMajor),
+      itsCacheSize(0),
+      itsCacheSlots(0),
+      itsMaxCacheSize(kDefaultMaxCacheSize),
+      itsChunked(false),
+      itsApplied(false),
+      itsPreviousSize(0),
+      itsPreviousSlots(0),
+      itsPreviousPreemption(0)
+{
+	auto max_cache_env = getenv("GRID_TO_RADON_NETCDF_CHUNK_CACHE_MB");
+
+	if (max_cache_env)
+	{
+		itsMaxCacheSize = std::stoul(max_cache_env) * 1024 * 1024;
+	}
+}
+
+bool NetCDFReadPlanner::Plan(const std::string& theFileName)
+{
+	himan::logger logr("netcdfreadplanner");
+
+	int ncid;
+
+	if (nc_open(theFileName.c_str(), NC_NOWRITE, &ncid) != NC_NOERR)
+	{
+		logr.Warning(fmt::format("Unable to open file '{}' for layout inspection", theFileName));
+		return false;
+	}
+
+	int format, nvars, recdim;
+
+	nc_inq_format(ncid, &format);
+	nc_inq_nvars(ncid, &nvars);
+	nc_inq_unlimdim(ncid, &recdim);
+
+	const bool classic = (format == NC_FORMAT_CLASSIC || format == NC_FORMAT_64BIT_OFFSET || format == NC_FORMAT_CDF5);
+	bool hasRecordVariables = false;
+
+	size_t maxChunks = 0;
+	size_t chunkedVariables = 0;
+
+	for (int varid = 0; varid < nvars; varid++)
+	{
+		int ndims;
+		nc_type type;
+		int dimids[NC_MAX_VAR_DIMS];
+
+		nc_inq_var(ncid, varid, nullptr, &type, &ndims, dimids, nullptr);
+
+		// Only variables with at least one dimension in addition to y and x
+		// have more than one slice
+
+		if (ndims < 3)
+		{
+			continue;
+		}
+
+		if (recdim != -1 && dimids[0] == recdim)
+		{
+			hasRecordVariables = true;
+		}
+
+		if (classic)
+		{
+			continue;
+		}
+
+		int storage;
+		std::vector<size_t> chunks(ndims, 0);
+
+		if (nc_inq_var_chunking(ncid, varid, &storage, chunks.data()) != NC_NOERR || storage != NC_CHUNKED)
+		{
+			continue;
+		}
+
+		itsChunked = true;
+		chunkedVariables++;
+
+		std::vector<size_t> lens(ndims, 0);
+
+		for (int i = 0; i < ndims; i++)
+		{
+			nc_inq_dimlen(ncid, dimids[i], &lens[i]);
+		}
+
+		size_t typeSize;
+		nc_inq_type(ncid, type, nullptr, &typeSize);
+
+		// Number of chunks needed to cover one 2D slice, and the size of
+		// those chunks
+
+		size_t sliceChunks = Blocks(lens[ndims - 1], chunks[ndims - 1]) * Blocks(lens[ndims - 2], chunks[ndims - 2]);
+		size_t chunkSize = typeSize;
+
+		for (int i = 0; i < ndims; i++)
+		{
+			chunkSize *= chunks[i];
+		}
+
+		// Slices are read time outer and level inner. If a chunk spans several
+		// time steps, all chunks of all levels of one time step must be kept
+		// so that they can be reused with the next time step. If it spans
+		// only levels, the chunks of one slice are enough.
+
+		if (ndims > 3 && chunks[0] > 1)
+		{
+			sliceChunks *= Blocks(lens[1], chunks[1]);
+		}
+
+		maxChunks = std::max(maxChunks, sliceChunks);
+		itsCacheSize = std::max(itsCacheSize, sliceChunks * chunkSize);
+	}
+
+	nc_close(ncid);
+
+	// Classic format files store the record variables interleaved record by
+	// record, so reading one time step of all parameters is sequential.
+	// Otherwise data of one variable is stored together.
+
+	itsOrder = (classic && hasRecordVariables) ? NetCDFReadOrder::kTimeMajor : NetCDFReadOrder::kParameterMajor;
+
+	// Maximum is shared by the caches of all chunked variables
+
+	const size_t maxCacheSize = itsMaxCacheSize / std::max<size_t>(1, chunkedVariables);
+
+	if (itsCacheSize > maxCacheSize)
+	{
+		logr.Warning(fmt::format(
+		    "Chunk cache of {} MB per variable needed to read each chunk once, limiting to {} MB for {} variables",
+		    itsCacheSize / 1024 / 1024, maxCacheSize / 1024 / 1024, chunkedVariables));
+		itsCacheSize = maxCacheSize;
+	}
+
+	// hdf5 recommends number of hash slots to be a prime number, and much
+	// larger than the number of chunks that fit in the cache
+	itsCacheSlots = NextPrime(std::max<size_t>(1009, 10 * maxChunks));
+
+	logr.Debug(ToString());
+
+	return true;
+}
+
+NetCDFReadPlanner::~NetCDFReadPlanner()
+{
+	Restore();
+}
+
+bool NetCDFReadPlanner::Apply()
+{
+	if (!itsChunked || itsApplied)
+	{
+		return true;
+	}
+
+	nc_get_chunk_cache(&itsPreviousSize, &itsPreviousSlots, &itsPreviousPreemption);
+
+	if (itsCacheSize <= itsPreviousSize)
+	{
+		return true;
+	}
+
+	itsApplied = (nc_set_chunk_cache(itsCacheSize, itsCacheSlots, itsPreviousPreemption) == NC_NOERR);
+
+	return itsApplied;
+}
+
+void NetCDFReadPlanner::Restore()
+{
+	if (itsApplied)
+	{
+		nc_set_chunk_cache(itsPreviousSize, itsPreviousSlots, itsPreviousPreemption);
+		itsApplied = false;
+	}
+}
+
+NetCDFReadOrder NetCDFReadPlanner::Order() const
+{
+	return itsOrder;
+}
+
+size_t NetCDFReadPlanner::CacheSize() const
+{
+	return itsCacheSize;
+}
+
+std::string NetCDFReadPlanner::ToString() const
+{
+	return fmt::format("read order: {}, chunked: {}, chunk cache: {:.1f} MB ({} slots)",
+	                   (itsOrder == NetCDFReadOrder::kTimeMajor) ? "time-major" : "parameter-major", itsChunked,
+	                   static_cast<double>(itsCacheSize) / 1024. / 1024., itsCacheSlots);
+}
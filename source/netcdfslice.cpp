@@ -0,0 +1,44 @@
+#include "netcdfslice.h"
+
+using namespace grid_to_radon;
+
+static bool Valid(const netcdfslice::slice& s)
+{
+	return !s.variable.empty() && s.variable.find('#') == std::string::npos &&
+	       s.time_index < netcdfslice::kMaxTimes && s.level_index < netcdfslice::kMaxLevels;
+}
+
+std::optional<std::string> netcdfslice::FileLocation(const slice& s)
+{
+	if (!Valid(s))
+	{
+		return std::nullopt;
+	}
+
+	return s.file_name + "#" + s.variable;
+}
+
+std::optional<unsigned long> netcdfslice::MessageNo(const slice& s)
+{
+	if (!Valid(s))
+	{
+		return std::nullopt;
+	}
+
+	return s.time_index * kMaxLevels + s.level_index;
+}
+
+// File name may contain '#', variable name does not
+
+std::optional<netcdfslice::slice> netcdfslice::Decode(const std::string& fileLocation, unsigned long messageNo)
+{
+	const auto pos = fileLocation.rfind('#');
+
+	if (pos == std::string::npos || pos == fileLocation.size() - 1 || messageNo >= kMaxTimes * kMaxLevels)
+	{
+		return std::nullopt;
+	}
+
+	return slice{fileLocation.substr(0, pos), fileLocation.substr(pos + 1), messageNo / kMaxLevels,
+	             messageNo % kMaxLevels};
+}
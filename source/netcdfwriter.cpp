@@ -0,0 +1,319 @@
+#include "netcdfwriter.h"
+#include "logger.h"
+#include "options.h"
+#include "timer.h"
+#include <algorithm>
+#include <filesystem>
+#include <fmt/format.h>
+#include <netcdf.h>
+#include <netcdf_meta.h>
+#include <regex>
+#include <vector>
+
+extern grid_to_radon::Options options;
+
+using namespace grid_to_radon;
+
+static bool Check(int status, const std::string& what)
+{
+	if (status != NC_NOERR)
+	{
+		himan::logger logr("netcdfwriter");
+		logr.Error(fmt::format("{} failed: {}", what, nc_strerror(status)));
+		return false;
+	}
+
+	return true;
+}
+
+// Parse chunk shape given as YxX, for example 256x256
+
+static bool ParseChunkShape(const std::string& shape, size_t& y, size_t& x)
+{
+	const static std::regex r("^([0-9]+)x([0-9]+)$");
+	std::smatch what;
+
+	if (!std::regex_match(shape, what, r))
+	{
+		return false;
+	}
+
+	y = std::stoul(what.str(1));
+	x = std::stoul(what.str(2));
+
+	return (y > 0 && x > 0);
+}
+
+static bool DefineFilters(int ncid, int varid, const std::vector<size_t>& dimlens)
+{
+	const size_t ndims = dimlens.size();
+
+	// Chunk holds at most one grid: leading dimensions (time, level) are
+	// chunked by one so that a single slice can be read without touching
+	// others
+
+	std::vector<size_t> chunks(ndims, 1);
+	chunks[ndims - 2] = dimlens[ndims - 2];
+	chunks[ndims - 1] = dimlens[ndims - 1];
+
+	size_t y, x;
+
+	if (!options.netcdf_chunk_shape.empty() && ParseChunkShape(options.netcdf_chunk_shape, y, x))
+	{
+		chunks[ndims - 2] = std::min(y, dimlens[ndims - 2]);
+		chunks[ndims - 1] = std::min(x, dimlens[ndims - 1]);
+	}
+
+	if (!Check(nc_def_var_chunking(ncid, varid, NC_CHUNKED, chunks.data()), "nc_def_var_chunking"))
+	{
+		return false;
+	}
+
+	const int shuffle = options.netcdf_shuffle ? 1 : 0;
+
+	if (options.netcdf_compression == "deflate")
+	{
+		const int level = (options.netcdf_compression_level == -1) ? 4 : options.netcdf_compression_level;
+		return Check(nc_def_var_deflate(ncid, varid, shuffle, 1, level), "nc_def_var_deflate");
+	}
+	else if (options.netcdf_compression == "zstd")
+	{
+#if defined(NC_HAS_ZSTD) && NC_HAS_ZSTD
+		const int level = (options.netcdf_compression_level == -1) ? 3 : options.netcdf_compression_level;
+
+		if (shuffle && !Check(nc_def_var_deflate(ncid, varid, shuffle, 0, 0), "nc_def_var_deflate"))
+		{
+			return false;
+		}
+
+		return Check(nc_def_var_zstandard(ncid, varid, level), "nc_def_var_zstandard");
+#else
+		himan::logger logr("netcdfwriter");
+		logr.Error("zstd compression not supported by netcdf library");
+		return false;
+#endif
+	}
+
+	if (shuffle)
+	{
+		return Check(nc_def_var_deflate(ncid, varid, shuffle, 0, 0), "nc_def_var_deflate");
+	}
+
+	return true;
+}
+
+static bool CopyAttributes(int in, int invar, int out, int outvar, int natts)
+{
+	for (int i = 0; i < natts; i++)
+	{
+		char name[NC_MAX_NAME + 1];
+
+		if (!Check(nc_inq_attname(in, invar, i, name), "nc_inq_attname") ||
+		    !Check(nc_copy_att(in, invar, name, out, outvar), "nc_copy_att"))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool CopyFile(int in, int out)
+{
+	int ndims, nvars, ngatts, unlimdim;
+
+	if (!Check(nc_inq(in, &ndims, &nvars, &ngatts, &unlimdim), "nc_inq"))
+	{
+		return false;
+	}
+
+	std::vector<size_t> dimlens(ndims);
+
+	for (int i = 0; i < ndims; i++)
+	{
+		char name[NC_MAX_NAME + 1];
+		int dimid;
+
+		if (!Check(nc_inq_dim(in, i, name, &dimlens[i]), "nc_inq_dim") ||
+		    !Check(nc_def_dim(out, name, (i == unlimdim) ? NC_UNLIMITED : dimlens[i], &dimid), "nc_def_dim"))
+		{
+			return false;
+		}
+	}
+
+	if (!CopyAttributes(in, NC_GLOBAL, out, NC_GLOBAL, ngatts))
+	{
+		return false;
+	}
+
+	for (int i = 0; i < nvars; i++)
+	{
+		char name[NC_MAX_NAME + 1];
+		nc_type type;
+		int vndims, natts, varid;
+		int dimids[NC_MAX_VAR_DIMS];
+
+		if (!Check(nc_inq_var(in, i, name, &type, &vndims, dimids, &natts), "nc_inq_var") ||
+		    !Check(nc_def_var(out, name, type, vndims, dimids, &varid), "nc_def_var"))
+		{
+			return false;
+		}
+
+		// Data variables are the ones with y and x dimensions
+
+		if (vndims >= 2)
+		{
+			std::vector<size_t> lens;
+
+			for (int j = 0; j < vndims; j++)
+			{
+				lens.push_back(dimlens[dimids[j]]);
+			}
+
+			if (!DefineFilters(out, varid, lens))
+			{
+				return false;
+			}
+		}
+
+		if (!CopyAttributes(in, i, out, varid, natts))
+		{
+			return false;
+		}
+	}
+
+	if (!Check(nc_enddef(out), "nc_enddef"))
+	{
+		return false;
+	}
+
+	for (int i = 0; i < nvars; i++)
+	{
+		nc_type type;
+		int vndims;
+		int dimids[NC_MAX_VAR_DIMS];
+		size_t typeSize;
+
+		nc_inq_var(in, i, nullptr, &type, &vndims, dimids, nullptr);
+		nc_inq_type(in, type, nullptr, &typeSize);
+
+		size_t size = typeSize;
+
+		// Record dimension of the new file has length 0 until records are
+		// written, so the whole input extent is given explicitly
+
+		std::vector<size_t> start(vndims, 0), count(vndims);
+
+		for (int j = 0; j < vndims; j++)
+		{
+			count[j] = dimlens[dimids[j]];
+			size *= count[j];
+		}
+
+		if (size == 0)
+		{
+			continue;
+		}
+
+		std::vector<unsigned char> buffer(size);
+
+		if (!Check(nc_get_vara(in, i, start.data(), count.data(), buffer.data()), "nc_get_vara") ||
+		    !Check(nc_put_vara(out, i, start.data(), count.data(), buffer.data()), "nc_put_vara"))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Read all data variables, as a downstream reader would do
+
+static size_t ReadBack(const std::string& fileName)
+{
+	himan::timer timer(true);
+
+	int ncid, nvars;
+
+	if (nc_open(fileName.c_str(), NC_NOWRITE, &ncid) != NC_NOERR)
+	{
+		return 0;
+	}
+
+	nc_inq_nvars(ncid, &nvars);
+
+	for (int i = 0; i < nvars; i++)
+	{
+		int ndims;
+		int dimids[NC_MAX_VAR_DIMS];
+
+		nc_inq_var(ncid, i, nullptr, nullptr, &ndims, dimids, nullptr);
+
+		if (ndims < 2)
+		{
+			continue;
+		}
+
+		size_t size = 1;
+
+		for (int j = 0; j < ndims; j++)
+		{
+			size_t len;
+			nc_inq_dimlen(ncid, dimids[j], &len);
+			size *= len;
+		}
+
+		std::vector<double> values(size);
+		nc_get_var_double(ncid, i, values.data());
+	}
+
+	nc_close(ncid);
+
+	timer.Stop();
+	return timer.GetTime();
+}
+
+bool netcdfwriter::Enabled()
+{
+	return (options.netcdf_compression != "none" || options.netcdf_shuffle || !options.netcdf_chunk_shape.empty());
+}
+
+bool netcdfwriter::Repack(const std::string& inputFileName, const std::string& outputFileName, write_stats& stats)
+{
+	himan::timer timer(true);
+
+	int in, out;
+
+	if (!Check(nc_open(inputFileName.c_str(), NC_NOWRITE, &in), "nc_open"))
+	{
+		return false;
+	}
+
+	if (!Check(nc_create(outputFileName.c_str(), NC_CLOBBER | NC_NETCDF4 | NC_CLASSIC_MODEL, &out), "nc_create"))
+	{
+		nc_close(in);
+		return false;
+	}
+
+	const bool ret = CopyFile(in, out);
+
+	nc_close(in);
+
+	if (!Check(nc_close(out), "nc_close") || !ret)
+	{
+		return false;
+	}
+
+	timer.Stop();
+
+	stats.write_time = timer.GetTime();
+	stats.input_size = std::filesystem::file_size(inputFileName);
+	stats.output_size = std::filesystem::file_size(outputFileName);
+
+	if (himan::logger::MainDebugState == himan::kDebugMsg || himan::logger::MainDebugState == himan::kTraceMsg)
+	{
+		stats.read_time = ReadBack(outputFileName);
+	}
+
+	return true;
+}
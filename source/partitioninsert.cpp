@@ -0,0 +1,242 @@
+#include "partitioninsert.h"
+#include "logger.h"
+#include <fmt/ranges.h>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+
+#define HIMAN_AUXILIARY_INCLUDE
+#include "radon.h"
+#undef HIMAN_AUXILIARY_INCLUDE
+
+using namespace grid_to_radon;
+
+namespace
+{
+struct partition
+{
+	std::string schema_name;
+	std::string table_name;
+	std::string partition_name;
+	int geometry_id;
+};
+
+// Key is producer, geometry name and analysis time. Value is empty if
+// partition was not found: rows go to the parent table through the plugin.
+
+std::shared_mutex partitionsMutex;
+std::map<std::string, std::optional<partition>> partitions;
+
+std::optional<partition> Resolve(std::shared_ptr<himan::plugin::radon>& r, long producerId,
+                                 const std::string& geometryName, const std::string& analysisTime)
+{
+	const std::string key = fmt::format("{}_{}_{}", producerId, geometryName, analysisTime);
+
+	{
+		std::shared_lock<std::shared_mutex> lock(partitionsMutex);
+
+		const auto it = partitions.find(key);
+
+		if (it != partitions.end())
+		{
+			return it->second;
+		}
+	}
+
+	std::unique_lock<std::shared_mutex> lock(partitionsMutex);
+
+	const auto it = partitions.find(key);
+
+	if (it != partitions.end())
+	{
+		return it->second;
+	}
+
+	himan::logger logr("partitioninsert");
+
+	r->RadonDB().Query(fmt::format(
+	    "SELECT a.schema_name, a.table_name, a.partition_name, a.geometry_id FROM as_grid a JOIN geom g ON "
+	    "(a.geometry_id = g.id) WHERE a.producer_id = {} AND g.name = '{}' AND a.analysis_time = '{}' AND "
+	    "to_regclass(a.schema_name || '.' || a.partition_name) IS NOT NULL",
+	    producerId, geometryName, analysisTime));
+
+	const auto row = r->RadonDB().FetchRow();
+
+	std::optional<partition> ret;
+
+	if (row.size() == 4 && !row[2].empty())
+	{
+		ret = partition{row[0], row[1], row[2], std::stoi(row[3])};
+		logr.Debug(fmt::format("Partition for {}: {}.{}", key, row[0], row[2]));
+	}
+	else
+	{
+		logr.Debug(fmt::format("Partition for {} not found, using parent table", key));
+	}
+
+	partitions[key] = ret;
+
+	return ret;
+}
+
+template <typename T>
+std::string OptionalValue(const std::optional<T>& value)
+{
+	return value ? std::to_string(value.value()) : "NULL";
+}
+
+// Lookup values are resolved by name in the same statement; an unknown name
+// gives NULL and the insert fails
+
+std::string LookupId(const std::string& table, const std::string& name)
+{
+	return fmt::format("(SELECT id FROM {} WHERE name = upper('{}'))", table, name);
+}
+}  // namespace
+
+const std::vector<std::string> partitioninsert::kColumns = {
+    "producer_id",        "analysis_time",         "geometry_id",            "param_id",
+    "level_id",           "level_value",           "level_value2",           "forecast_period",
+    "forecast_type_id",   "forecast_type_value",   "aggregation_id",         "aggregation_period",
+    "processing_type_id", "processing_type_value", "processing_type_value2", "file_location",
+    "file_server",        "file_format_id",        "file_protocol_id",       "message_no",
+    "byte_offset",        "byte_length"};
+
+std::string partitioninsert::InsertQuery(const std::string& schemaName, const std::string& partitionName,
+                                         const record& rec, const himan::param& par,
+                                         const himan::file_information& finfo)
+{
+	std::string aggregationId = "NULL", aggregationPeriod = "NULL";
+
+	if (par.Aggregation().Type() != himan::kUnknownAggregationType)
+	{
+		aggregationId = LookupId("aggregation", himan::HPAggregationTypeToString.at(par.Aggregation().Type()));
+		aggregationPeriod = fmt::format("'{}'", par.Aggregation().TimeDuration().String("%h:%02M:%02S"));
+	}
+
+	std::string processingTypeId = "NULL", processingTypeValue = "NULL", processingTypeValue2 = "NULL";
+
+	if (par.ProcessingType().Type() != himan::kUnknownProcessingType)
+	{
+		processingTypeId =
+		    LookupId("processing_type", himan::HPProcessingTypeToString.at(par.ProcessingType().Type()));
+
+		if (par.ProcessingType().Value() != himan::kHPMissingValue)
+		{
+			processingTypeValue = fmt::format("{}", par.ProcessingType().Value());
+		}
+
+		if (par.ProcessingType().Value2() != himan::kHPMissingValue)
+		{
+			processingTypeValue2 = fmt::format("{}", par.ProcessingType().Value2());
+		}
+	}
+
+	const double levelValue2 = (rec.level_value2 == himan::kHPMissingValue) ? -1 : rec.level_value2;
+	const double ftypeValue = (rec.forecast_type_value == himan::kHPMissingValue) ? -1 : rec.forecast_type_value;
+
+	const std::string fileServer = finfo.file_server.empty() ? "NULL" : fmt::format("'{}'", finfo.file_server);
+
+	// Values in the order of kColumns
+
+	const std::vector<std::string> values = {fmt::format("{}", rec.producer_id),
+	                                         fmt::format("'{}'", rec.analysis_time.str()),
+	                                         fmt::format("{}", rec.geometry_id),
+	                                         fmt::format("{}", rec.param_id),
+	                                         LookupId("level", himan::HPLevelTypeToString.at(rec.level_type)),
+	                                         fmt::format("{}", rec.level_value),
+	                                         fmt::format("{}", levelValue2),
+	                                         fmt::format("'{}'", rec.forecast_period.str()),
+	                                         fmt::format("{}", static_cast<int>(rec.forecast_type_id)),
+	                                         fmt::format("{}", ftypeValue),
+	                                         aggregationId,
+	                                         aggregationPeriod,
+	                                         processingTypeId,
+	                                         processingTypeValue,
+	                                         processingTypeValue2,
+	                                         fmt::format("'{}'", finfo.file_location),
+	                                         fileServer,
+	                                         fmt::format("{}", static_cast<int>(finfo.file_type)),
+	                                         fmt::format("{}", static_cast<int>(finfo.storage_type)),
+	                                         OptionalValue(finfo.message_no),
+	                                         OptionalValue(finfo.offset),
+	                                         OptionalValue(finfo.length)};
+
+	return fmt::format("INSERT INTO {}.{} ({}) VALUES ({}) ON CONFLICT DO NOTHING RETURNING 1", schemaName,
+	                   partitionName, fmt::join(kColumns, ", "), fmt::join(values, ", "));
+}
+
+std::string partitioninsert::ExistsQuery(const record& rec)
+{
+	const double levelValue2 = (rec.level_value2 == himan::kHPMissingValue) ? -1 : rec.level_value2;
+	const double ftypeValue = (rec.forecast_type_value == himan::kHPMissingValue) ? -1 : rec.forecast_type_value;
+
+	return fmt::format(
+	    "SELECT 1 FROM as_grid a WHERE a.schema_name = '{0}' AND '{1}' IN (a.table_name, a.partition_name) AND "
+	    "a.producer_id = {2} AND a.geometry_id = {3} AND a.analysis_time = '{4}' AND to_regclass(a.schema_name || "
+	    "'.' || a.partition_name) IS NOT NULL AND EXISTS (SELECT 1 FROM {0}.{1} g WHERE g.producer_id = {2} AND "
+	    "g.geometry_id = {3} AND g.analysis_time = '{4}' AND g.param_id = {5} AND g.level_id = {6} AND "
+	    "g.level_value = {7} AND g.level_value2 = {8} AND g.forecast_period = '{9}' AND g.forecast_type_id = {10} "
+	    "AND g.forecast_type_value = {11} AND g.file_location = '{12}')",
+	    rec.schema_name.str(), rec.table_name.str(), rec.producer_id, rec.geometry_id, rec.analysis_time.str(),
+	    rec.param_id, LookupId("level", himan::HPLevelTypeToString.at(rec.level_type)), rec.level_value, levelValue2,
+	    rec.forecast_period.str(), static_cast<int>(rec.forecast_type_id), ftypeValue, rec.file_name);
+}
+
+std::optional<record> partitioninsert::Save(std::shared_ptr<himan::configuration>& config,
+                                            std::shared_ptr<himan::info<double>>& info,
+                                            std::shared_ptr<himan::plugin::radon>& r,
+                                            const himan::file_information& finfo)
+{
+	// Only grib file formats map directly to file_format ids
+
+	if (finfo.file_type != himan::kGRIB1 && finfo.file_type != himan::kGRIB2)
+	{
+		return std::nullopt;
+	}
+
+	const std::string analysisTime = info->Time().OriginDateTime().ToSQLTime();
+	const auto part = Resolve(r, info->Producer().Id(), config->TargetGeomName(), analysisTime);
+
+	if (!part)
+	{
+		return std::nullopt;
+	}
+
+	record rec(part->schema_name, part->table_name, finfo.file_location, config->OutputFileType(),
+	           config->TargetGeomName(), part->geometry_id, info->Producer(), info->ForecastType(), info->Time(),
+	           info->Level(), info->Param());
+
+	const std::string query = InsertQuery(part->schema_name, part->partition_name, rec, info->Param(), finfo);
+
+	try
+	{
+		r->RadonDB().Query(query);
+
+		// No row returned: field exists already and is updated by the plugin
+
+		if (r->RadonDB().FetchRow().empty())
+		{
+			return std::nullopt;
+		}
+	}
+#if PQXX_VERSION_MAJOR < 7
+	catch (const pqxx::pqxx_exception& e)
+	{
+		himan::logger logr("partitioninsert");
+		logr.Warning(fmt::format("Insert to partition {}.{} failed: {}", part->schema_name, part->partition_name,
+		                         e.base().what()));
+		return std::nullopt;
+	}
+#else
+	catch (const pqxx::failure& e)
+	{
+		himan::logger logr("partitioninsert");
+		logr.Warning(
+		    fmt::format("Insert to partition {}.{} failed: {}", part->schema_name, part->partition_name, e.what()));
+		return std::nullopt;
+	}
+#endif
+
+	return rec;
+}
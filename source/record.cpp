@@ -0,0 +1,74 @@
+#include "record.h"
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+
+using namespace grid_to_radon;
+
+// Elements of unordered_set are not moved on rehash, so pointers to them
+// stay valid for the lifetime of the process
+
+static const std::string* Intern(const std::string& str)
+{
+	static std::shared_mutex internMutex;
+	static std::unordered_set<std::string> internTable;
+
+	{
+		std::shared_lock<std::shared_mutex> lock(internMutex);
+
+		const auto it = internTable.find(str);
+
+		if (it != internTable.end())
+		{
+			return &(*it);
+		}
+	}
+
+	std::unique_lock<std::shared_mutex> lock(internMutex);
+
+	return &(*internTable.insert(str).first);
+}
+
+interned_string::interned_string() : itsString(Intern(""))
+{
+}
+
+interned_string::interned_string(const std::string& str) : itsString(Intern(str))
+{
+}
+
+record::record()
+    : file_type(himan::kUnknownFile),
+      geometry_id(0),
+      producer_id(0),
+      forecast_type_id(himan::kUnknownType),
+      forecast_type_value(himan::kHPMissingValue),
+      level_type(himan::kUnknownLevel),
+      level_value(himan::kHPMissingValue),
+      level_value2(himan::kHPMissingValue),
+      param_id(0)
+{
+}
+
+record::record(const std::string& schema_name_, const std::string& table_name_, const std::string& file_name_,
+               himan::HPFileType file_type_, const std::string& geometry_name_, int geometry_id_,
+               const himan::producer& producer_, const himan::forecast_type& ftype_,
+               const himan::forecast_time& ftime_, const himan::level& level_, const himan::param& param_)
+    : schema_name(schema_name_),
+      table_name(table_name_),
+      file_name(file_name_),
+      file_type(file_type_),
+      geometry_name(geometry_name_),
+      geometry_id(geometry_id_),
+      producer_id(static_cast<int>(producer_.Id())),
+      forecast_type_id(ftype_.Type()),
+      forecast_type_value(ftype_.Value()),
+      analysis_time(ftime_.OriginDateTime().ToSQLTime()),
+      forecast_period(ftime_.Step().String("%h:%02M:%02S")),
+      level_type(level_.Type()),
+      level_value(level_.Value()),
+      level_value2(level_.Value2()),
+      param_id(static_cast<int>(param_.Id())),
+      param_name(param_.Name())
+{
+}
@@ -0,0 +1,186 @@
+#include "recordsink.h"
+#include "common.h"
+#include "logger.h"
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <cstdio>
+#include <fmt/format.h>
+#include <stdexcept>
+
+using namespace grid_to_radon;
+
+// std::quoted is c++14
+static std::string quoted(const std::string& v)
+{
+	return fmt::format("\"{}\"", v);
+}
+
+std::string grid_to_radon::RecordToJSON(const record& rec)
+{
+	// If this gets any more complicated an actual JSON
+	// library should be used?
+
+	// clang-format off
+	std::string json = fmt::format("{{ {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {}, {} : {} }}",
+		quoted("schema_name"), quoted(rec.schema_name),
+		quoted("table_name"), quoted(rec.table_name),
+		quoted("file_name"), quoted(rec.file_name),
+		quoted("file_type"), fmt::underlying(rec.file_type),
+		quoted("geometry_name"), quoted(rec.geometry_name),
+		quoted("geometry_id"), rec.geometry_id,
+		quoted("producer_id"), rec.producer_id,
+		quoted("forecast_type_id"), fmt::underlying(rec.forecast_type_id),
+		quoted("forecast_type_value"), rec.forecast_type_value,
+		quoted("analysis_time"), quoted(rec.analysis_time),
+		quoted("forecast_period"), quoted(rec.forecast_period),
+		quoted("level_id"), fmt::underlying(rec.level_type),
+		quoted("level_value"), rec.level_value,
+		quoted("level_value2"), rec.level_value2,
+		quoted("param_name"), quoted(rec.param_name));
+	// clang-format on
+
+	if (rec.stats.count > 0)
+	{
+		// All values missing: min, max and mean are NaN, which is not valid json
+		const bool valid = (rec.stats.missing < rec.stats.count);
+
+		json.resize(json.size() - 2);
+		json += fmt::format(", {} : {{ {} : {}, {} : {}, {} : {}, {} : {}, {} : {} }} }}", quoted("statistics"),
+		                    quoted("count"), rec.stats.count, quoted("missing"), rec.stats.missing, quoted("min"),
+		                    valid ? fmt::format("{}", rec.stats.min) : "null", quoted("max"),
+		                    valid ? fmt::format("{}", rec.stats.max) : "null", quoted("mean"),
+		                    valid ? fmt::format("{}", rec.stats.mean) : "null");
+	}
+
+	return json;
+}
+
+MetadataWriter::MetadataWriter(const std::string& theFileName) : itsFileName(theFileName), itsCount(0)
+{
+	if (itsFileName.empty())
+	{
+		return;
+	}
+
+	const std::string VERSION = "20261019";
+
+	itsStream.open(itsFileName + ".tmp");
+
+	if (!itsStream)
+	{
+		throw std::runtime_error(fmt::format("Unable to open metadata file '{}'", itsFileName));
+	}
+
+	itsStream << "{\n  " << quoted("version") << " : " << quoted(VERSION) << ", " << quoted("records") << " : [";
+}
+
+MetadataWriter::~MetadataWriter()
+{
+	Close();
+}
+
+void MetadataWriter::Add(const record& rec)
+{
+	if (itsFileName.empty())
+	{
+		return;
+	}
+
+	const std::string json = RecordToJSON(rec);
+
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	if (itsCount++ > 0)
+	{
+		itsStream << ",\n";
+	}
+
+	itsStream << "    " << json;
+}
+
+void MetadataWriter::Close()
+{
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	if (!itsStream.is_open())
+	{
+		return;
+	}
+
+	itsStream << "  ]\n}";
+	itsStream.close();
+
+	std::rename((itsFileName + ".tmp").c_str(), itsFileName.c_str());
+
+	himan::logger logr("grid_to_radon");
+	logr.Info(fmt::format("Wrote metadata to '{}'", itsFileName));
+}
+
+void SSStateCollector::Add(const record& rec)
+{
+	const ss_state_key key = common::MakeSSStateKey(rec);
+
+	std::lock_guard<std::mutex> lock(itsMutex);
+	itsKeys.insert(key);
+	itsTables.insert(rec.table_name.str());
+}
+
+void SSStateCollector::Add(const ss_state_key& key)
+{
+	std::lock_guard<std::mutex> lock(itsMutex);
+	itsKeys.insert(key);
+	itsTables.insert(key.table_name);
+}
+
+ss_state_keys SSStateCollector::Keys() const
+{
+	std::lock_guard<std::mutex> lock(itsMutex);
+	return ss_state_keys(itsKeys.begin(), itsKeys.end());
+}
+
+std::set<std::string> SSStateCollector::Tables() const
+{
+	std::lock_guard<std::mutex> lock(itsMutex);
+	return itsTables;
+}
+
+ss_state_keys grid_to_radon::ReadSSStateKeys(const std::string& theFileName)
+{
+	namespace pt = boost::property_tree;
+
+	pt::ptree tree;
+	pt::read_json(theFileName, tree);
+
+	ss_state_keys keys;
+
+	for (const auto& child : tree.get_child("records"))
+	{
+		const auto& rec = child.second;
+
+		const auto geometryId = rec.get_optional<int>("geometry_id");
+
+		if (!geometryId)
+		{
+			throw std::runtime_error(
+			    fmt::format("Metadata file '{}' has no geometry_id, it is written by an older version", theFileName));
+		}
+
+		double ftypeValue = rec.get<double>("forecast_type_value");
+
+		if (ftypeValue == himan::kHPMissingValue)
+		{
+			ftypeValue = -1;
+		}
+
+		keys.push_back(ss_state_key{rec.get<long>("producer_id"),
+		                            geometryId.get(),
+		                            rec.get<std::string>("analysis_time"),
+		                            rec.get<std::string>("forecast_period"),
+		                            rec.get<int>("forecast_type_id"),
+		                            ftypeValue,
+		                            rec.get<std::string>("schema_name"),
+		                            rec.get<std::string>("table_name")});
+	}
+
+	return keys;
+}
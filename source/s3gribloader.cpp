@@ -1,6 +1,9 @@
 #include "s3gribloader.h"
 #include "NFmiGrib.h"
 #include "common.h"
+#include "fieldstats.h"
+#include "gribfilter.h"
+#include "hybridlevelheight.h"
 #include "options.h"
 #include "plugin_factory.h"
 #include "s3.h"
@@ -23,29 +26,37 @@ extern std::pair<std::shared_ptr<himan::configuration>, std::shared_ptr<himan::i
 
 static int g_success = 0;
 static int g_failed = 0;
+static int g_skipped = 0;
 
-grid_to_radon::records ProcessGribFile(std::unique_ptr<FILE> fp, const std::string& filename)
+void ProcessGribFile(std::unique_ptr<FILE> fp, const std::string& filename, grid_to_radon::RecordSink& sink,
+                     grid_to_radon::SSStateCollector& collected, grid_to_radon::HybridLevelHeight* hybridLevelHeight)
 {
 	himan::timer othertimer(true);
 	himan::logger logr("s3gribloader");
 
-	grid_to_radon::records recs;
-
 	NFmiGrib reader;
 	if (!reader.Open(std::move(fp)))
 	{
 		logr.Error("Failed to open file from memory");
-		return recs;
+		return;
 	}
 
 	int messageNo = -1;
 	auto r = GET_PLUGIN(radon);
 
+	const grid_to_radon::GribFilter filter(options.filter);
+
 	const auto plainFilename = grid_to_radon::common::StripProtocol(filename);
-	while (reader.NextMessage())
+	while (!grid_to_radon::common::StopRequested() && reader.NextMessage())
 	{
 		messageNo++;
 
+		if (!filter.Matches(reader.Message()))
+		{
+			g_skipped++;
+			continue;
+		}
+
 		try
 		{
 			othertimer.Start();
@@ -78,7 +89,21 @@ grid_to_radon::records ProcessGribFile(std::unique_ptr<FILE> fp, const std::stri
 				                       othertimer.GetTime()));
 
 				g_success++;
-				recs.push_back(ret.second);
+
+				const bool hybrid = hybridLevelHeight && grid_to_radon::HybridLevelHeight::Wanted(*info);
+
+				if (options.field_stats || hybrid)
+				{
+					ret.second.stats = grid_to_radon::fieldstats::Compute(info->Data().Values());
+				}
+
+				if (hybrid)
+				{
+					hybridLevelHeight->Add(*info, config->TargetGeomName(), ret.second.stats);
+				}
+
+				sink.Add(ret.second);
+				collected.Add(ret.second);
 			}
 		}
 		catch (const himan::HPExceptionType& e)
@@ -105,7 +130,6 @@ grid_to_radon::records ProcessGribFile(std::unique_ptr<FILE> fp, const std::stri
 			g_failed++;
 		}
 	}
-	return recs;
 }
 
 grid_to_radon::S3GribLoader::S3GribLoader() : itsHost(nullptr)
@@ -118,26 +142,29 @@ grid_to_radon::S3GribLoader::S3GribLoader() : itsHost(nullptr)
 	}
 }
 
-std::pair<bool, grid_to_radon::records> grid_to_radon::S3GribLoader::Load(const std::string& theFileName) const
+bool grid_to_radon::S3GribLoader::Load(const std::string& theFileName, RecordSink& sink,
+                                       HybridLevelHeight* hybridLevelHeight) const
 {
 	g_success = 0;
 	g_failed = 0;
+	g_skipped = 0;
 
 	unsigned long objectSize = himan::s3::ObjectSize(theFileName);
-	grid_to_radon::records recs = ReadFileStream(theFileName, 0, objectSize);
+	SSStateCollector collected;
+	ReadFileStream(theFileName, 0, objectSize, sink, collected, hybridLevelHeight);
 
-	common::UpdateSSState(recs);
+	common::UpdateSSState(collected.Keys());
 
 	himan::logger logr("s3gribloader");
-	logr.Info(fmt::format("Success with {} fields, failed with {} fields", g_success, g_failed));
-
-	bool retval = common::CheckForFailure(g_failed, 0, g_success);
+	logr.Info(fmt::format("Success with {} fields, failed with {} fields, skipped {} fields", g_success, g_failed,
+	                      g_skipped));
 
-	return std::make_pair(retval, recs);
+	return common::CheckForFailure(g_failed, g_skipped, g_success);
 }
 
-grid_to_radon::records grid_to_radon::S3GribLoader::ReadFileStream(const std::string& theFileName, size_t startByte,
-                                                                   size_t byteCount) const
+void grid_to_radon::S3GribLoader::ReadFileStream(const std::string& theFileName, size_t startByte, size_t byteCount,
+                                                 RecordSink& sink, SSStateCollector& collected,
+                                                 HybridLevelHeight* hybridLevelHeight) const
 {
 	himan::logger logr("s3gribloader");
 
@@ -152,5 +179,5 @@ grid_to_radon::records grid_to_radon::S3GribLoader::ReadFileStream(const std::st
 	auto buffer = himan::s3::ReadFile(finfo);
 
 	std::unique_ptr<FILE> fp(fmemopen(buffer.data, buffer.length, "r"));
-	return ProcessGribFile(std::move(fp), theFileName);
+	ProcessGribFile(std::move(fp), theFileName, sink, collected, hybridLevelHeight);
 }
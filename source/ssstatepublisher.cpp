@@ -0,0 +1,149 @@
+#include "ssstatepublisher.h"
+#include "common.h"
+#include "logger.h"
+#include "options.h"
+#include <fmt/format.h>
+
+extern grid_to_radon::Options options;
+
+using namespace grid_to_radon;
+
+SSStatePublisher::SSStatePublisher() : itsPublishedCount(0), itsStopped(false)
+{
+}
+
+SSStatePublisher::~SSStatePublisher()
+{
+	Stop();
+}
+
+void SSStatePublisher::Start()
+{
+	itsThread = std::thread(&SSStatePublisher::Run, this);
+}
+
+void SSStatePublisher::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+		itsStopped = true;
+	}
+
+	itsCondition.notify_all();
+
+	if (itsThread.joinable())
+	{
+		itsThread.join();
+	}
+}
+
+void SSStatePublisher::Add(const record& rec)
+{
+	Add(common::MakeSSStateKey(rec));
+}
+
+void SSStatePublisher::Add(const ss_state_key& key)
+{
+	std::lock_guard<std::mutex> lock(itsMutex);
+
+	auto& g = itsGroups[key];
+	g.count++;
+	g.dirty = true;
+	g.last_update = std::chrono::steady_clock::now();
+
+	if (options.ss_state_group_size > 0 && g.count == options.ss_state_group_size)
+	{
+		itsCondition.notify_all();
+	}
+}
+
+void SSStatePublisher::Flush()
+{
+	ss_state_keys keys;
+
+	{
+		std::lock_guard<std::mutex> lock(itsMutex);
+
+		for (auto& it : itsGroups)
+		{
+			if (it.second.dirty)
+			{
+				keys.push_back(it.first);
+				it.second.dirty = false;
+			}
+		}
+	}
+
+	Publish(keys);
+}
+
+size_t SSStatePublisher::PublishedCount() const
+{
+	std::lock_guard<std::mutex> lock(itsMutex);
+	return itsPublishedCount;
+}
+
+void SSStatePublisher::Publish(const ss_state_keys& keys)
+{
+	if (keys.empty())
+	{
+		return;
+	}
+
+	common::UpdateSSState(keys);
+
+	himan::logger logr("ssstatepublisher");
+
+	for (const auto& key : keys)
+	{
+		logr.Debug(fmt::format("Published ss_state for producer {} analysis time {} step {} forecast type {}/{}",
+		                       key.producer_id, key.analysis_time, key.forecast_period, key.forecast_type_id,
+		                       key.forecast_type_value));
+	}
+
+	std::lock_guard<std::mutex> lock(itsMutex);
+	itsPublishedCount += keys.size();
+}
+
+void SSStatePublisher::Run()
+{
+	const auto quietPeriod = std::chrono::seconds(options.ss_state_quiet_period);
+
+	std::unique_lock<std::mutex> lock(itsMutex);
+
+	while (!itsStopped)
+	{
+		itsCondition.wait_for(lock, std::chrono::seconds(1));
+
+		const auto now = std::chrono::steady_clock::now();
+
+		ss_state_keys keys;
+
+		for (auto& it : itsGroups)
+		{
+			auto& g = it.second;
+
+			if (!g.dirty)
+			{
+				continue;
+			}
+
+			const bool complete =
+			    (!g.completed && options.ss_state_group_size > 0 && g.count >= options.ss_state_group_size);
+
+			if (complete || now - g.last_update >= quietPeriod)
+			{
+				keys.push_back(it.first);
+				g.dirty = false;
+				g.completed = g.completed || complete;
+			}
+		}
+
+		if (!keys.empty())
+		{
+			lock.unlock();
+			Publish(keys);
+			lock.lock();
+		}
+	}
+}
@@ -0,0 +1,24 @@
+-- Content hashes of grib messages loaded by grid_to_radon --skip-unchanged.
+--
+-- A message whose hash matches the stored one is not written or registered
+-- again; the stored registration is used to update ss_state and metadata.
+-- The unsigned 64 bit hash is stored as bigint with the same bit pattern.
+
+CREATE TABLE IF NOT EXISTS grid_to_radon_hash (
+  key text PRIMARY KEY,
+  hash bigint NOT NULL,
+  file_location text NOT NULL,
+  schema_name text NOT NULL,
+  table_name text NOT NULL,
+  geometry_id integer NOT NULL,
+  last_updated timestamp with time zone NOT NULL DEFAULT now()
+);
+
+-- Upgrade of tables created before registration details were stored.
+-- Rows without them are treated as changed and rewritten on next load.
+
+ALTER TABLE grid_to_radon_hash ADD COLUMN IF NOT EXISTS schema_name text;
+ALTER TABLE grid_to_radon_hash ADD COLUMN IF NOT EXISTS table_name text;
+ALTER TABLE grid_to_radon_hash ADD COLUMN IF NOT EXISTS geometry_id integer;
+
+GRANT SELECT, INSERT, UPDATE ON grid_to_radon_hash TO radon_rw;